@@ -1,55 +1,214 @@
 /******************************************************************************
  * keygen: Generate a key of a length passed in as the argument
  * The characters of the key are randomly selected from A..Z plus ' '
+ * USAGE: keygen [-o path] [-j threads] length
+ *   without -o the key is written to stdout, a chunk at a time
+ *   with -o the file is preallocated to its full size, threads fill
+ *   disjoint regions of it with pwrite, and it is synced once at the end
+ * Random bytes come from getrandom; those past the largest multiple of
+ * 27 are rejected, so every character is equally likely
 *******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "otp_helpers.h"
 
-char* generateKey(int length);
+#define KEYGEN_CHUNK_SIZE 1048576       // Bytes generated and written at a time
+#define MAX_KEYGEN_THREADS 64
+#define ACCEPTED_BYTES (256 - 256 % NUM_CHAR_CHOICES)  // Random bytes below this are used
+
+struct keygenRegion {
+    pthread_t thread;
+    int fd;
+    off_t start;
+    off_t end;
+    int status;                         // 0, or the errno that stopped this region
+};
+
+static void usage(char *program);
+static int fillKey(char* key, size_t length);
+static int writeKeyStdout(unsigned long long length);
+static int writeKeyFile(const char* path, unsigned long long length, int numThreads);
+static void* fillRegion(void* arg);
 
 int main(int argc, char *argv[])
 {
-    srand((unsigned)time(NULL));
+    char* outputPath = NULL;
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char* end;
+    int option;
+
+    while ((option = getopt(argc, argv, "o:j:")) != -1) {
+        switch (option) {
+            case 'o': outputPath = optarg; break;
+            case 'j':
+                numThreads = atoi(optarg);
+                if (numThreads < 1) { usage(argv[0]); }
+                break;
+            default: usage(argv[0]);
+        }
+    }
 
     //Check for valid arguments
-    if (argc != 2 || atoi(argv[1]) < 0) {
-        fprintf(stderr, "Error: keygen must be called with a positive integer for key length\n");
+    if (optind != argc - 1 || argv[optind][0] == '-') { usage(argv[0]); }
+    errno = 0;
+    unsigned long long keyLength = strtoull(argv[optind], &end, 10);
+    if (errno || *end || end == argv[optind]) { usage(argv[0]); }
+
+    if (numThreads < 1) { numThreads = 1; }
+    if (numThreads > MAX_KEYGEN_THREADS) { numThreads = MAX_KEYGEN_THREADS; }
+
+    //Generate the key and write it out
+    int status = outputPath ? writeKeyFile(outputPath, keyLength, numThreads) : writeKeyStdout(keyLength);
+    if (status != 0) {
+        fprintf(stderr, "keygen: %s: %s\n", outputPath ? outputPath : "stdout", strerror(status));
         return 1;
     }
 
-    //Generate the key and print to stdout
-    int keyLength = atoi(argv[1]);
-    char* newKey = generateKey(keyLength);
-    printf("%s", newKey);
+    return 0;
+}
+
+/*******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void usage(char *program)
+{
+    fprintf(stderr, "Error: keygen must be called with a positive integer for key length\n");
+    fprintf(stderr, "USAGE: %s [-o path] [-j threads] length\n", program);
+    exit(1);
+}
+
+/*******************************************************************************
+ * Fill passed-in buffer with length random key characters
+ * Returns 0, or the errno of a failed getrandom
+*******************************************************************************/
+static int fillKey(char* key, size_t length)
+{
+    unsigned char random[65536];
+    size_t filled = 0;
 
-    free(newKey);
+    while (filled < length) {
+        // About 5% of bytes are rejected, so ask for a little over what is left
+        size_t wanted = (length - filled) + (length - filled) / 16 + 16;
+        ssize_t numRandom = getrandom(random, wanted < sizeof(random) ? wanted : sizeof(random), 0);
+        if (numRandom < 0) {
+            if (errno == EINTR) { continue; }
+            return errno;
+        }
+        for (ssize_t i = 0; i < numRandom && filled < length; i++) {
+            if (random[i] < ACCEPTED_BYTES) { key[filled++] = keyChars[random[i] % NUM_CHAR_CHOICES]; }
+        }
+    }
 
     return 0;
 }
 
 /*******************************************************************************
- * Return a random string of the passed-in length
- * Uses defined array of all capital letters plus a space ' '
+ * Write a key of passed-in length plus a newline to stdout
+ * Returns 0, or an errno
+*******************************************************************************/
+static int writeKeyStdout(unsigned long long length)
+{
+    char* chunk = malloc(KEYGEN_CHUNK_SIZE + 1);
+    if (!chunk) { return ENOMEM; }
+
+    // A zero-length key is still written as its newline
+    int status = 0;
+    do {
+        size_t chunkLength = length < KEYGEN_CHUNK_SIZE ? (size_t)length : KEYGEN_CHUNK_SIZE;
+        length -= chunkLength;
+        status = fillKey(chunk, chunkLength);
+        if (length == 0) { chunk[chunkLength++] = '\n'; }
+        if (status == 0 && fwrite(chunk, 1, chunkLength, stdout) != chunkLength) { status = errno ? errno : EIO; }
+    } while (status == 0 && length > 0);
+    if (status == 0 && fflush(stdout) != 0) { status = errno; }
+
+    free(chunk);
+    return status;
+}
+
+/*******************************************************************************
+ * Write a key of passed-in length plus a newline to the file at path
+ * The file is allocated up front so regions written out of order never
+ * leave holes, and so a full disk is found before any key is generated
+ * Returns 0, or the first errno met
 *******************************************************************************/
-char* generateKey(int length)
+static int writeKeyFile(const char* path, unsigned long long length, int numThreads)
 {
-    char keyChars[27] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K',
-                         'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V',
-                         'W', 'X', 'Y', 'Z', ' '};
+    struct keygenRegion regions[MAX_KEYGEN_THREADS];
+    int status = 0;
 
-    //Allocate enough space for the length + newline
-    char* returnKey = calloc( ((size_t)length + 1), sizeof(char) );
+    // Keys are secret, so the file is only readable by its owner
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) { return errno; }
+
+    off_t fileLength = (off_t)length + 1;
+    if ((status = posix_fallocate(fd, 0, fileLength)) != 0) {
+        // Filesystems without fallocate are still written, just not reserved first
+        if (status != EOPNOTSUPP && status != EINVAL) { close(fd); return status; }
+        if (ftruncate(fd, fileLength) < 0) { status = errno; close(fd); return status; }
+        status = 0;
+    }
+
+    // Whole chunks per thread, so no two threads ever share a chunk
+    unsigned long long numChunks = (length + KEYGEN_CHUNK_SIZE - 1) / KEYGEN_CHUNK_SIZE;
+    if ((unsigned long long)numThreads > numChunks) { numThreads = numChunks ? (int)numChunks : 1; }
+
+    int numStarted = 0;
+    for (int i = 0; i < numThreads; i++) {
+        regions[i].fd = fd;
+        regions[i].start = (off_t)(numChunks * i / numThreads) * KEYGEN_CHUNK_SIZE;
+        regions[i].end = (off_t)(numChunks * (i + 1) / numThreads) * KEYGEN_CHUNK_SIZE;
+        if (regions[i].end > (off_t)length) { regions[i].end = (off_t)length; }
+        regions[i].status = 0;
+        if ((status = pthread_create(&regions[i].thread, NULL, fillRegion, &regions[i])) != 0) { break; }
+        numStarted++;
+    }
 
-    //Randomly generate each character of the key and add a newline
-    for (int i = 0; i < length; i++) {
-        int charIdx = rand() % 27;
-        returnKey[i] = keyChars[charIdx];
+    for (int i = 0; i < numStarted; i++) {
+        pthread_join(regions[i].thread, NULL);
+        if (status == 0) { status = regions[i].status; }
     }
-    returnKey[length] = '\n';
 
-    return returnKey;
+    if (status == 0 && pwrite(fd, "\n", 1, (off_t)length) != 1) { status = errno; }
+    if (status == 0 && fsync(fd) < 0) { status = errno; }
+    if (close(fd) < 0 && status == 0) { status = errno; }
+
+    return status;
 }
 
+/*******************************************************************************
+ * Thread: generate and write the key between a region's start and end
+*******************************************************************************/
+static void* fillRegion(void* arg)
+{
+    struct keygenRegion* region = arg;
+
+    char* chunk = malloc(KEYGEN_CHUNK_SIZE);
+    if (!chunk) { region->status = ENOMEM; return NULL; }
+
+    for (off_t offset = region->start; offset < region->end && region->status == 0; ) {
+        size_t chunkLength = (size_t)(region->end - offset < KEYGEN_CHUNK_SIZE ? region->end - offset : KEYGEN_CHUNK_SIZE);
+        if ((region->status = fillKey(chunk, chunkLength)) != 0) { break; }
+
+        for (size_t written = 0; written < chunkLength; ) {
+            ssize_t numWritten = pwrite(region->fd, chunk + written, chunkLength - written, offset + (off_t)written);
+            if (numWritten < 0) {
+                if (errno == EINTR) { continue; }
+                region->status = errno;
+                break;
+            }
+            written += (size_t)numWritten;
+        }
+        offset += (off_t)chunkLength;
+    }
+
+    free(chunk);
+    return NULL;
+}
@@ -0,0 +1,338 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * Source file defines the in-process transform and the protocol client
+ * The local path is table driven: one lookup per key/input symbol and
+ * one per output symbol, no division, no allocation and no syscalls
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include "libotp.h"
+
+struct otpConnection {
+    int socketFD;
+    char mode;
+    int checksums;                      // Send checked frames and verify replies
+};
+
+// Symbol value + 1 for each valid character, 0 marks an invalid character
+static const unsigned char symbolValue[256] = {
+    ['A'] = 1,  ['B'] = 2,  ['C'] = 3,  ['D'] = 4,  ['E'] = 5,  ['F'] = 6,
+    ['G'] = 7,  ['H'] = 8,  ['I'] = 9,  ['J'] = 10, ['K'] = 11, ['L'] = 12,
+    ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17, ['R'] = 18,
+    ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+    ['Y'] = 25, ['Z'] = 26, [' '] = 27
+};
+
+// symbolTable[j] is symbol (j - 2) mod 27, so with the +1 values above
+// (msg + key) encrypts and (msg - key + 29) decrypts without a modulo
+// Invalid (0) values still index inside the table; the result is discarded
+#define SYMBOL_TABLE_SIZE (2 * OTP_NUM_SYMBOLS + 3)
+static const char symbolTable[SYMBOL_TABLE_SIZE + 1] =
+    "Z ABCDEFGHIJKLMNOPQRSTUVWXYZ ABCDEFGHIJKLMNOPQRSTUVWXYZ A";
+
+static otpStageHook stageHook = NULL;
+
+/*******************************************************************************
+ * Return a short description of the passed-in status code
+*******************************************************************************/
+const char* otpStatusString(int status)
+{
+    switch (status) {
+        case OTP_OK:            return "success";
+        case OTP_ERR_MODE:      return "not a valid mode";
+        case OTP_ERR_BAD_CHARS: return "input contains bad characters";
+        case OTP_ERR_KEY_SHORT: return "key is too short";
+        case OTP_ERR_BUFFER:    return "output buffer is too small";
+        case OTP_ERR_RESOLVE:   return "no such host";
+        case OTP_ERR_CONNECT:   return "could not connect";
+        case OTP_ERR_HANDSHAKE: return "daemon does not serve this mode";
+        case OTP_ERR_IO:        return "connection error";
+        case OTP_ERR_PROTOCOL:  return "malformed reply from daemon";
+        case OTP_ERR_CHECKSUM:  return "frame failed its integrity check";
+        default:                return "unknown error";
+    }
+}
+
+/*******************************************************************************
+ * Returns whether each of the passed-in length characters is a valid symbol
+*******************************************************************************/
+int otpCheckChars(const char* input, size_t length)
+{
+    unsigned char valid = 1;
+
+    // Accumulate without branching so the loop vectorizes
+    for (size_t i = 0; i < length; i++) {
+        valid &= (symbolValue[(unsigned char)input[i]] != 0);
+    }
+
+    return valid;
+}
+
+/*******************************************************************************
+ * Encrypt or decrypt length symbols of input with key into caller's output
+ * Output is NUL terminated if outputCapacity leaves room for it
+ * Returns OTP_OK or a negative otpStatus
+*******************************************************************************/
+int otpTransform(char mode, const char* key, size_t keyLength,
+                 const char* input, size_t length, char* output, size_t outputCapacity)
+{
+    unsigned char invalid = 0;
+
+    if (mode != OTP_ENCRYPT && mode != OTP_DECRYPT) { return OTP_ERR_MODE; }
+    if (keyLength < length) { return OTP_ERR_KEY_SHORT; }
+    if (outputCapacity < length) { return OTP_ERR_BUFFER; }
+
+    if (mode == OTP_ENCRYPT) {
+        for (size_t i = 0; i < length; i++) {
+            int msgVal = symbolValue[(unsigned char)input[i]];
+            int keyVal = symbolValue[(unsigned char)key[i]];
+            invalid |= (msgVal == 0) | (keyVal == 0);
+            output[i] = symbolTable[msgVal + keyVal];
+        }
+    }
+    else {
+        for (size_t i = 0; i < length; i++) {
+            int msgVal = symbolValue[(unsigned char)input[i]];
+            int keyVal = symbolValue[(unsigned char)key[i]];
+            invalid |= (msgVal == 0) | (keyVal == 0);
+            output[i] = symbolTable[msgVal - keyVal + OTP_NUM_SYMBOLS + 2];
+        }
+    }
+
+    if (invalid) { return OTP_ERR_BAD_CHARS; }
+    if (outputCapacity > length) { output[length] = '\0'; }
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Install a function called as the remote path passes each otpStage
+ * Pass NULL to remove it
+*******************************************************************************/
+void otpSetStageHook(otpStageHook hook)
+{
+    stageHook = hook;
+}
+
+static void reachStage(enum otpStage stage)
+{
+    if (stageHook) { stageHook(stage); }
+}
+
+/*******************************************************************************
+ * Receive exactly length bytes into buffer
+*******************************************************************************/
+static int recvAll(int socketFD, char* buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t charsRead = recv(socketFD, buffer, length, 0);
+        if (charsRead < 0) {
+            if (errno == EINTR) { continue; }
+            return OTP_ERR_IO;
+        }
+        if (charsRead == 0) { return OTP_ERR_IO; }             // Daemon closed connection
+        buffer += charsRead;
+        length -= (size_t)charsRead;
+    }
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Receive an acknowledgement of known text, or OTP_RESEND if the daemon
+ * found the frame corrupt (returned as OTP_ERR_CHECKSUM)
+ * Reading exactly its length leaves the following reply in the socket
+*******************************************************************************/
+static int recvAck(int socketFD, const char* ack)
+{
+    char ackBuffer[32];
+    const char* expected = ack;
+
+    // The first byte tells an ack from a resend request
+    int status = recvAll(socketFD, ackBuffer, 1);
+    if (status != OTP_OK) { return status; }
+    if (ackBuffer[0] == OTP_RESEND[0]) { expected = OTP_RESEND; }
+
+    size_t expectedLength = strlen(expected);
+    status = recvAll(socketFD, ackBuffer + 1, expectedLength - 1);
+    if (status != OTP_OK) { return status; }
+    if (memcmp(ackBuffer, expected, expectedLength) != 0) { return OTP_ERR_PROTOCOL; }
+
+    return expected == ack ? OTP_OK : OTP_ERR_CHECKSUM;
+}
+
+/*******************************************************************************
+ * Send length bytes of payload as a frame and wait for its ack
+ * With checksums on, the frame carries a header with its CRC32C
+ * and is resent while the daemon answers OTP_RESEND
+ * sentStage is reached once each send is out, ackStage once its answer is in
+*******************************************************************************/
+static int sendAcknowledged(struct otpConnection* connection, const char* payload, size_t length,
+                            uint32_t checksum, const char* ack, enum otpStage sentStage, enum otpStage ackStage)
+{
+    char header[OTP_FRAME_HEADER_SIZE + 1];
+    int status = OTP_ERR_CHECKSUM;
+
+    if (connection->checksums) { otpFormatFrameHeader(header, length, checksum); }
+
+    for (int attempt = 0; attempt <= OTP_MAX_RETRANSMITS && status == OTP_ERR_CHECKSUM; attempt++) {
+        if (connection->checksums) {
+            status = otpSendFrame(connection->socketFD, header, OTP_FRAME_HEADER_SIZE, payload, length);
+        }
+        else {
+            status = otpSendFrame(connection->socketFD, NULL, 0, payload, length);
+        }
+        if (status != OTP_OK) { return status; }
+        reachStage(sentStage);
+
+        status = recvAck(connection->socketFD, ack);
+        reachStage(ackStage);
+    }
+
+    return status;
+}
+
+/*******************************************************************************
+ * Resolve host, connect to the daemon on port and complete the handshake
+ * for mode (OTP_ENCRYPT or OTP_DECRYPT)
+ * On success store a new handle in *connection and return OTP_OK
+*******************************************************************************/
+int otpConnect(const char* host, int port, char mode, struct otpConnection** connection)
+{
+    struct addrinfo hints, *serverAddresses = NULL;
+    char portString[16];
+    char serverResponse = '\0';
+    int socketFD = -1;
+
+    if (mode != OTP_ENCRYPT && mode != OTP_DECRYPT) { return OTP_ERR_MODE; }
+
+    // Resolve host (getaddrinfo is thread safe, unlike gethostbyname)
+    memset(&hints, '\0', sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(portString, sizeof(portString), "%d", port);
+    if (getaddrinfo(host, portString, &hints, &serverAddresses) != 0) { return OTP_ERR_RESOLVE; }
+    reachStage(OTP_STAGE_RESOLVE);
+
+    // Set up the socket and connect to the daemon
+    socketFD = socket(AF_INET, SOCK_STREAM, 0);
+    if (socketFD < 0) { freeaddrinfo(serverAddresses); return OTP_ERR_CONNECT; }
+
+    if (connect(socketFD, serverAddresses->ai_addr, serverAddresses->ai_addrlen) < 0) {
+        freeaddrinfo(serverAddresses);
+        close(socketFD);
+        return OTP_ERR_CONNECT;
+    }
+    freeaddrinfo(serverAddresses);
+    reachStage(OTP_STAGE_CONNECT);
+
+    // Every frame is a single write, so Nagle would only delay small requests
+    int noDelay = 1;
+    setsockopt(socketFD, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    // Send mode and check for success response
+    if (otpSendAll(socketFD, &mode, sizeof(char)) != OTP_OK ||
+        recvAll(socketFD, &serverResponse, sizeof(char)) != OTP_OK ||
+        serverResponse != OTP_HANDSHAKE_OK) {
+        close(socketFD);
+        return OTP_ERR_HANDSHAKE;
+    }
+    reachStage(OTP_STAGE_HANDSHAKE);
+
+    *connection = malloc(sizeof(struct otpConnection));
+    if (!*connection) { close(socketFD); return OTP_ERR_IO; }
+    (*connection)->socketFD = socketFD;
+    (*connection)->mode = mode;
+
+    // OTP_CHECKSUM=1 turns on verification without changing the caller
+    const char* checksumSetting = getenv("OTP_CHECKSUM");
+    (*connection)->checksums = checksumSetting && checksumSetting[0] && strcmp(checksumSetting, "0") != 0;
+
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Transform length symbols of input through the connected daemon
+ * Only the first length key symbols are sent
+ * The reply is received straight into the caller's output buffer
+ * With checksums on, a reply failing its CRC32C is requested again
+ * The handle stays usable for further requests while OTP_OK is returned
+*******************************************************************************/
+int otpRemoteTransform(struct otpConnection* connection, const char* key, size_t keyLength,
+                       const char* input, size_t length, char* output, size_t outputCapacity)
+{
+    char terminator[sizeof(OTP_TERMINATOR)];
+    char header[OTP_FRAME_HEADER_SIZE];
+    uint32_t keyChecksum = 0, inputChecksum = 0, replyChecksum = 0;
+    size_t replyLength = 0;
+    int status = OTP_OK;
+
+    if (keyLength < length) { return OTP_ERR_KEY_SHORT; }
+    if (outputCapacity < length) { return OTP_ERR_BUFFER; }
+
+    // Validate characters, checksumming in the same pass if needed
+    if (connection->checksums) {
+        if (!otpCheckCharsChecksum(key, length, &keyChecksum) ||
+            !otpCheckCharsChecksum(input, length, &inputChecksum)) { return OTP_ERR_BAD_CHARS; }
+    }
+    else if (!otpCheckChars(key, length) || !otpCheckChars(input, length)) {
+        return OTP_ERR_BAD_CHARS;
+    }
+
+    for (int attempt = 0; attempt <= OTP_MAX_RETRANSMITS; attempt++) {
+
+        // Send key and message, waiting for each acknowledgement
+        status = sendAcknowledged(connection, key, length, keyChecksum, OTP_KEY_ACK,
+                                  OTP_STAGE_SEND_KEY, OTP_STAGE_KEY_ACK);
+        if (status != OTP_OK) { return status; }
+        status = sendAcknowledged(connection, input, length, inputChecksum, OTP_MESSAGE_ACK,
+                                  OTP_STAGE_SEND_TEXT, OTP_STAGE_TEXT_ACK);
+        if (status != OTP_OK) { return status; }
+
+        // Checked replies declare their length and checksum up front
+        if (connection->checksums) {
+            if ((status = recvAll(connection->socketFD, header, sizeof(header))) != OTP_OK) { return status; }
+            if (otpParseFrameHeader(header, &replyLength, &replyChecksum) != OTP_OK || replyLength != length) {
+                return OTP_ERR_PROTOCOL;
+            }
+        }
+
+        // Reply has the same length as the message, followed by the terminator
+        if ((status = recvAll(connection->socketFD, output, length)) != OTP_OK) { return status; }
+        if ((status = recvAll(connection->socketFD, terminator, strlen(OTP_TERMINATOR))) != OTP_OK) { return status; }
+        if (memcmp(terminator, OTP_TERMINATOR, strlen(OTP_TERMINATOR)) != 0) { return OTP_ERR_PROTOCOL; }
+        reachStage(OTP_STAGE_RECEIVE);
+
+        if (!connection->checksums || otpFrameChecksum(header, otpCrc32c(0, output, length)) == replyChecksum) {
+            if (outputCapacity > length) { output[length] = '\0'; }
+            return OTP_OK;
+        }
+    }
+
+    return OTP_ERR_CHECKSUM;
+}
+
+/*******************************************************************************
+ * Turn CRC32C verification of frames on or off for this connection
+*******************************************************************************/
+void otpSetChecksums(struct otpConnection* connection, int enabled)
+{
+    connection->checksums = enabled;
+}
+
+/*******************************************************************************
+ * Close the connection and free the handle
+*******************************************************************************/
+void otpClose(struct otpConnection* connection)
+{
+    if (!connection) { return; }
+    close(connection->socketFD);
+    free(connection);
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * Header file declares the in-process API used by otp_enc/otp_dec and
+ * by services that would rather link the code than fork a client:
+ *   local transform with caller-provided buffers (no allocation, no syscalls)
+ *   connection handles that talk the otp_enc_d/otp_dec_d protocol
+ *   a pool of warm connections serving asynchronous requests
+ *   optional CRC32C verification of every frame (OTP_CHECKSUM=1 or otpSetChecksums)
+*******************************************************************************/
+
+#ifndef OTP_LIBOTP_H
+#define OTP_LIBOTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTP_NUM_SYMBOLS 27
+#define OTP_ENCRYPT 'E'
+#define OTP_DECRYPT 'D'
+
+// Wire protocol shared with the daemons
+#define OTP_TERMINATOR "@@"
+#define OTP_HANDSHAKE_OK 'S'
+#define OTP_HANDSHAKE_FAIL 'F'
+#define OTP_KEY_ACK "received connection"
+#define OTP_MESSAGE_ACK "received plaintext"
+#define OTP_ZEROCOPY_THRESHOLD 262144   // Smaller payloads are cheaper to copy than to pin
+
+// Checked frames start with '#', 16 hex digits of length, 8 hex digits of CRC32C, ';'
+// The CRC32C covers the payload and then the length digits
+// Unchecked frames are just payload and terminator, as sent by older clients
+#define OTP_FRAME_MAGIC '#'
+#define OTP_FRAME_HEADER_SIZE 26
+#define OTP_RESEND "RESEND"             // Sent instead of an ack when a frame fails its check
+#define OTP_MAX_RETRANSMITS 3
+
+enum otpStatus {
+    OTP_OK = 0,
+    OTP_ERR_MODE = -1,              // mode is neither OTP_ENCRYPT nor OTP_DECRYPT
+    OTP_ERR_BAD_CHARS = -2,         // key or input holds a symbol outside A-Z and ' '
+    OTP_ERR_KEY_SHORT = -3,         // key is shorter than input
+    OTP_ERR_BUFFER = -4,            // output buffer is smaller than input
+    OTP_ERR_RESOLVE = -5,           // host name could not be resolved
+    OTP_ERR_CONNECT = -6,           // socket or connect failed
+    OTP_ERR_HANDSHAKE = -7,         // daemon refused this mode
+    OTP_ERR_IO = -8,                // send/recv failed or daemon closed connection
+    OTP_ERR_PROTOCOL = -9,          // daemon reply was malformed
+    OTP_ERR_CHECKSUM = -10          // frame still corrupt after OTP_MAX_RETRANSMITS resends
+};
+
+// Points at which the remote path reports progress (see otpSetStageHook)
+enum otpStage {
+    OTP_STAGE_RESOLVE,
+    OTP_STAGE_CONNECT,
+    OTP_STAGE_HANDSHAKE,
+    OTP_STAGE_SEND_KEY,
+    OTP_STAGE_KEY_ACK,
+    OTP_STAGE_SEND_TEXT,
+    OTP_STAGE_TEXT_ACK,
+    OTP_STAGE_RECEIVE
+};
+
+typedef void (*otpStageHook)(enum otpStage stage);
+typedef void (*otpCallback)(int status, void* userData);
+
+struct otpConnection;
+struct otpPool;
+struct otpFuture;
+
+const char* otpStatusString(int status);
+int otpCheckChars(const char* input, size_t length);
+int otpTransform(char mode, const char* key, size_t keyLength,
+                 const char* input, size_t length, char* output, size_t outputCapacity);
+
+uint32_t otpCrc32c(uint32_t crc, const void* data, size_t length);
+int otpCheckCharsChecksum(const char* input, size_t length, uint32_t* checksum);
+int otpTransformChecksum(char mode, const char* key, size_t keyLength,
+                         const char* input, size_t length, char* output, size_t outputCapacity,
+                         uint32_t* checksum);
+uint32_t otpFrameChecksum(const char* header, uint32_t payloadChecksum);
+void otpFormatFrameHeader(char* header, size_t length, uint32_t checksum);
+int otpParseFrameHeader(const char* header, size_t* length, uint32_t* checksum);
+
+int otpSendAll(int socketFD, const char* buffer, size_t length);
+int otpSendFrame(int socketFD, const char* header, size_t headerLength,
+                 const char* payload, size_t length);
+
+void otpSetStageHook(otpStageHook hook);
+int otpConnect(const char* host, int port, char mode, struct otpConnection** connection);
+int otpRemoteTransform(struct otpConnection* connection, const char* key, size_t keyLength,
+                       const char* input, size_t length, char* output, size_t outputCapacity);
+void otpSetChecksums(struct otpConnection* connection, int enabled);
+void otpClose(struct otpConnection* connection);
+
+int otpPoolCreate(const char* host, int port, char mode, int size, struct otpPool** pool);
+int otpPoolSubmit(struct otpPool* pool, const char* key, size_t keyLength,
+                  const char* input, size_t length, char* output, size_t outputCapacity,
+                  otpCallback callback, void* userData);
+struct otpFuture* otpPoolSubmitFuture(struct otpPool* pool, const char* key, size_t keyLength,
+                                      const char* input, size_t length, char* output, size_t outputCapacity);
+int otpFutureWait(struct otpFuture* future);
+void otpPoolDestroy(struct otpPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //OTP_LIBOTP_H
@@ -0,0 +1,150 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * C++ header wraps the C API in libotp.h:
+ *   otp::transform for the local path into a caller-provided buffer
+ *   otp::Connection owns a daemon connection and closes it on destruction
+ *   otp::Pool owns a connection pool and returns std::future results
+ * Errors are reported as otp::Error exceptions carrying the otpStatus
+*******************************************************************************/
+
+#ifndef OTP_LIBOTP_HPP
+#define OTP_LIBOTP_HPP
+
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "libotp.h"
+
+namespace otp {
+
+enum class Mode : char { Encrypt = OTP_ENCRYPT, Decrypt = OTP_DECRYPT };
+
+class Error : public std::runtime_error {
+public:
+    explicit Error(int status) : std::runtime_error(otpStatusString(status)), status_(status) {}
+    int status() const noexcept { return status_; }
+
+private:
+    int status_;
+};
+
+inline void check(int status)
+{
+    if (status != OTP_OK) { throw Error(status); }
+}
+
+/*******************************************************************************
+ * Transform input with key into output, which must hold input.size() chars
+*******************************************************************************/
+inline void transform(Mode mode, std::string_view key, std::string_view input, char* output, size_t outputCapacity)
+{
+    check(otpTransform(static_cast<char>(mode), key.data(), key.size(),
+                       input.data(), input.size(), output, outputCapacity));
+}
+
+inline std::string transform(Mode mode, std::string_view key, std::string_view input)
+{
+    std::string output(input.size(), '\0');
+    transform(mode, key, input, output.data(), output.size());
+    return output;
+}
+
+/*******************************************************************************
+ * Move-only handle on one daemon connection
+*******************************************************************************/
+class Connection {
+public:
+    Connection(const std::string& host, int port, Mode mode)
+    {
+        check(otpConnect(host.c_str(), port, static_cast<char>(mode), &connection_));
+    }
+
+    ~Connection() { otpClose(connection_); }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    Connection(Connection&& other) noexcept : connection_(std::exchange(other.connection_, nullptr)) {}
+    Connection& operator=(Connection&& other) noexcept
+    {
+        if (this != &other) {
+            otpClose(connection_);
+            connection_ = std::exchange(other.connection_, nullptr);
+        }
+        return *this;
+    }
+
+    void transform(std::string_view key, std::string_view input, char* output, size_t outputCapacity)
+    {
+        check(otpRemoteTransform(connection_, key.data(), key.size(),
+                                 input.data(), input.size(), output, outputCapacity));
+    }
+
+    std::string transform(std::string_view key, std::string_view input)
+    {
+        std::string output(input.size(), '\0');
+        transform(key, input, output.data(), output.size());
+        return output;
+    }
+
+private:
+    otpConnection* connection_ = nullptr;
+};
+
+/*******************************************************************************
+ * Move-only handle on a pool of daemon connections
+ * Buffers passed to submit must stay valid until its future is ready
+*******************************************************************************/
+class Pool {
+public:
+    Pool(const std::string& host, int port, Mode mode, int size)
+    {
+        check(otpPoolCreate(host.c_str(), port, static_cast<char>(mode), size, &pool_));
+    }
+
+    ~Pool() { otpPoolDestroy(pool_); }
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    Pool(Pool&& other) noexcept : pool_(std::exchange(other.pool_, nullptr)) {}
+    Pool& operator=(Pool&& other) noexcept
+    {
+        if (this != &other) {
+            otpPoolDestroy(pool_);
+            pool_ = std::exchange(other.pool_, nullptr);
+        }
+        return *this;
+    }
+
+    std::future<void> submit(std::string_view key, std::string_view input, char* output, size_t outputCapacity)
+    {
+        auto* promise = new std::promise<void>();
+        std::future<void> result = promise->get_future();
+
+        int status = otpPoolSubmit(pool_, key.data(), key.size(), input.data(), input.size(),
+                                   output, outputCapacity, &Pool::complete, promise);
+        if (status != OTP_OK) {
+            delete promise;
+            throw Error(status);
+        }
+        return result;
+    }
+
+private:
+    static void complete(int status, void* userData)
+    {
+        auto* promise = static_cast<std::promise<void>*>(userData);
+        if (status == OTP_OK) { promise->set_value(); }
+        else { promise->set_exception(std::make_exception_ptr(Error(status))); }
+        delete promise;
+    }
+
+    otpPool* pool_ = nullptr;
+};
+
+} // namespace otp
+
+#endif //OTP_LIBOTP_HPP
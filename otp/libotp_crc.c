@@ -0,0 +1,200 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * Source file defines the CRC32C (Castagnoli) used to verify frames:
+ *   SSE4.2 crc32 instruction, 8 bytes per step, when the CPU has it
+ *   slice-by-8 tables otherwise
+ *   transform and character check variants that checksum each block
+ *   while it is still in L1, instead of making a second pass
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include "libotp.h"
+
+#define CRC32C_POLYNOMIAL 0x82F63B78u   // Reflected Castagnoli polynomial
+#define CRC_BLOCK_SIZE 8192             // Transform/check this much, then checksum it
+
+static uint32_t crcTable[8][256];
+static int haveSSE42 = 0;
+
+/*******************************************************************************
+ * Build the slice-by-8 tables and probe the CPU once at load time
+*******************************************************************************/
+__attribute__((constructor))
+static void initCrcTables()
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1u)));
+        }
+        crcTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 8; slice++) {
+            crcTable[slice][i] = (crcTable[slice - 1][i] >> 8) ^ crcTable[0][crcTable[slice - 1][i] & 0xFF];
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    haveSSE42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/*******************************************************************************
+ * Table-driven CRC32C over passed-in bytes, 8 bytes per table round
+*******************************************************************************/
+static uint32_t crcSliceBy8(uint32_t crc, const unsigned char* data, size_t length)
+{
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));                      // Little-endian load
+        word ^= crc;
+        crc = crcTable[7][word & 0xFF] ^ crcTable[6][(word >> 8) & 0xFF] ^
+              crcTable[5][(word >> 16) & 0xFF] ^ crcTable[4][(word >> 24) & 0xFF] ^
+              crcTable[3][(word >> 32) & 0xFF] ^ crcTable[2][(word >> 40) & 0xFF] ^
+              crcTable[1][(word >> 48) & 0xFF] ^ crcTable[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/*******************************************************************************
+ * CRC32C with the SSE4.2 crc32 instruction
+*******************************************************************************/
+__attribute__((target("sse4.2")))
+static uint32_t crcSSE42(uint32_t crc, const unsigned char* data, size_t length)
+{
+    uint64_t crc64 = crc;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (length--) {
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+/*******************************************************************************
+ * Continue a CRC32C: pass 0 to start, or a previous result to extend it
+*******************************************************************************/
+uint32_t otpCrc32c(uint32_t crc, const void* data, size_t length)
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (haveSSE42) { return ~crcSSE42(crc, data, length); }
+#endif
+    return ~crcSliceBy8(crc, data, length);
+}
+
+/*******************************************************************************
+ * otpCheckChars that also returns the CRC32C of input in *checksum
+*******************************************************************************/
+int otpCheckCharsChecksum(const char* input, size_t length, uint32_t* checksum)
+{
+    int valid = 1;
+    uint32_t crc = 0;
+
+    for (size_t offset = 0; offset < length; offset += CRC_BLOCK_SIZE) {
+        size_t blockLength = length - offset < CRC_BLOCK_SIZE ? length - offset : CRC_BLOCK_SIZE;
+        valid &= otpCheckChars(input + offset, blockLength);
+        crc = otpCrc32c(crc, input + offset, blockLength);
+    }
+
+    *checksum = crc;
+    return valid;
+}
+
+/*******************************************************************************
+ * otpTransform that also returns the CRC32C of output in *checksum
+*******************************************************************************/
+int otpTransformChecksum(char mode, const char* key, size_t keyLength,
+                         const char* input, size_t length, char* output, size_t outputCapacity,
+                         uint32_t* checksum)
+{
+    uint32_t crc = 0;
+
+    if (keyLength < length) { return OTP_ERR_KEY_SHORT; }
+    if (outputCapacity < length) { return OTP_ERR_BUFFER; }
+
+    for (size_t offset = 0; offset < length; offset += CRC_BLOCK_SIZE) {
+        size_t blockLength = length - offset < CRC_BLOCK_SIZE ? length - offset : CRC_BLOCK_SIZE;
+
+        int status = otpTransform(mode, key + offset, blockLength, input + offset, blockLength,
+                                  output + offset, blockLength);
+        if (status != OTP_OK) { return status; }
+        crc = otpCrc32c(crc, output + offset, blockLength);
+    }
+
+    if (outputCapacity > length) { output[length] = '\0'; }
+    *checksum = crc;
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Returns the check value a frame header carries: its payload's CRC32C
+ * continued over the header's length digits, so a corrupt length fails
+ * the check too
+*******************************************************************************/
+uint32_t otpFrameChecksum(const char* header, uint32_t payloadChecksum)
+{
+    return otpCrc32c(payloadChecksum, header + 1, 16);
+}
+
+/*******************************************************************************
+ * Write the frame header for a payload of length with checksum (its
+ * CRC32C) into header, which must hold OTP_FRAME_HEADER_SIZE + 1 chars
+*******************************************************************************/
+void otpFormatFrameHeader(char* header, size_t length, uint32_t checksum)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    header[0] = OTP_FRAME_MAGIC;
+    for (int i = 0; i < 16; i++) {
+        header[16 - i] = hexDigits[(length >> (4 * i)) & 0xF];
+    }
+    checksum = otpFrameChecksum(header, checksum);
+    for (int i = 0; i < 8; i++) {
+        header[24 - i] = hexDigits[(checksum >> (4 * i)) & 0xF];
+    }
+    header[25] = ';';
+    header[26] = '\0';
+}
+
+/*******************************************************************************
+ * Parse a frame header; returns OTP_OK or OTP_ERR_PROTOCOL if malformed
+ * *checksum is the header's check value, to compare with otpFrameChecksum
+*******************************************************************************/
+int otpParseFrameHeader(const char* header, size_t* length, uint32_t* checksum)
+{
+    uint64_t parsedLength = 0;
+    uint32_t parsedChecksum = 0;
+
+    if (header[0] != OTP_FRAME_MAGIC || header[OTP_FRAME_HEADER_SIZE - 1] != ';') { return OTP_ERR_PROTOCOL; }
+
+    for (int i = 1; i < OTP_FRAME_HEADER_SIZE - 1; i++) {
+        char c = header[i];
+        int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (digit < 0) { return OTP_ERR_PROTOCOL; }
+
+        if (i <= 16) { parsedLength = (parsedLength << 4) | (uint64_t)digit; }
+        else { parsedChecksum = (parsedChecksum << 4) | (uint32_t)digit; }
+    }
+
+    *length = (size_t)parsedLength;
+    *checksum = parsedChecksum;
+    return OTP_OK;
+}
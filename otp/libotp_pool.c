@@ -0,0 +1,289 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * Source file defines the client connection pool:
+ *   one worker thread per warm daemon connection
+ *   requests are queued and taken by whichever connection is free
+ *   completion is reported through a callback or a waitable future
+ *   a connection that fails is reopened and the request retried once
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libotp.h"
+
+struct otpRequest {
+    const char* key;
+    size_t keyLength;
+    const char* input;
+    size_t length;
+    char* output;
+    size_t outputCapacity;
+    otpCallback callback;
+    void* userData;
+    struct otpRequest* next;
+};
+
+struct otpFuture {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int finished;
+    int status;
+};
+
+struct otpPool {
+    char* host;
+    int port;
+    char mode;
+    int size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t pending;
+    struct otpRequest* head;                // Requests are served in submission order
+    struct otpRequest* tail;
+    int shuttingDown;
+
+    pthread_t* workers;
+    struct otpConnection** connections;
+};
+
+struct poolWorker {
+    struct otpPool* pool;
+    int index;
+};
+
+/*******************************************************************************
+ * Returns whether a failed request should be retried on a fresh connection
+ * Errors about the request itself would fail again, so only I/O errors qualify
+*******************************************************************************/
+static int isConnectionError(int status)
+{
+    return status == OTP_ERR_IO || status == OTP_ERR_PROTOCOL;
+}
+
+/*******************************************************************************
+ * Run one request on the worker's connection, (re)connecting as needed
+*******************************************************************************/
+static int serveRequest(struct otpPool* pool, int index, struct otpRequest* request)
+{
+    int status = OTP_OK;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!pool->connections[index]) {
+            status = otpConnect(pool->host, pool->port, pool->mode, &pool->connections[index]);
+            if (status != OTP_OK) { pool->connections[index] = NULL; continue; }
+        }
+
+        status = otpRemoteTransform(pool->connections[index], request->key, request->keyLength,
+                                    request->input, request->length,
+                                    request->output, request->outputCapacity);
+        if (!isConnectionError(status)) { return status; }
+
+        // Drop the dead connection; the next attempt reconnects
+        otpClose(pool->connections[index]);
+        pool->connections[index] = NULL;
+    }
+
+    return status;
+}
+
+/*******************************************************************************
+ * Worker thread: take queued requests until the pool shuts down
+*******************************************************************************/
+static void* runPoolWorker(void* argument)
+{
+    struct poolWorker* worker = argument;
+    struct otpPool* pool = worker->pool;
+    int index = worker->index;
+    free(worker);
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->shuttingDown) {
+            pthread_cond_wait(&pool->pending, &pool->lock);
+        }
+        if (!pool->head) {                                      // Shutting down and queue drained
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        struct otpRequest* request = pool->head;
+        pool->head = request->next;
+        if (!pool->head) { pool->tail = NULL; }
+        pthread_mutex_unlock(&pool->lock);
+
+        int status = serveRequest(pool, index, request);
+        request->callback(status, request->userData);
+        free(request);
+    }
+
+    otpClose(pool->connections[index]);
+    pool->connections[index] = NULL;
+    return NULL;
+}
+
+/*******************************************************************************
+ * Create a pool of size connections to the daemon on host:port for mode
+ * The first connection is opened before returning so a bad address or
+ * wrong daemon is reported here; the rest are opened by their workers
+*******************************************************************************/
+int otpPoolCreate(const char* host, int port, char mode, int size, struct otpPool** poolOut)
+{
+    struct otpConnection* firstConnection = NULL;
+
+    if (size < 1) { size = 1; }
+
+    int status = otpConnect(host, port, mode, &firstConnection);
+    if (status != OTP_OK) { return status; }
+
+    struct otpPool* pool = calloc(1, sizeof(struct otpPool));
+    if (!pool) { otpClose(firstConnection); return OTP_ERR_IO; }
+
+    pool->host = strdup(host);
+    pool->port = port;
+    pool->mode = mode;
+    pool->size = size;
+    pool->workers = calloc((size_t)size, sizeof(pthread_t));
+    pool->connections = calloc((size_t)size, sizeof(struct otpConnection*));
+    if (!pool->host || !pool->workers || !pool->connections) {
+        free(pool->host);
+        free(pool->workers);
+        free(pool->connections);
+        free(pool);
+        otpClose(firstConnection);
+        return OTP_ERR_IO;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->pending, NULL);
+    pool->connections[0] = firstConnection;
+
+    for (int i = 0; i < size; i++) {
+        struct poolWorker* worker = malloc(sizeof(struct poolWorker));
+        if (worker) {
+            worker->pool = pool;
+            worker->index = i;
+        }
+        if (!worker || pthread_create(&pool->workers[i], NULL, runPoolWorker, worker) != 0) {
+            // Stop the workers already running; the first closes its own connection
+            free(worker);
+            if (i == 0) { otpClose(firstConnection); }
+            pool->size = i;
+            otpPoolDestroy(pool);
+            return OTP_ERR_IO;
+        }
+    }
+
+    *poolOut = pool;
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Queue a request; callback(status, userData) runs on a pool thread
+ * once output holds the result. Key, input and output must stay valid
+ * until then. Returns OTP_OK if queued
+*******************************************************************************/
+int otpPoolSubmit(struct otpPool* pool, const char* key, size_t keyLength,
+                  const char* input, size_t length, char* output, size_t outputCapacity,
+                  otpCallback callback, void* userData)
+{
+    struct otpRequest* request = malloc(sizeof(struct otpRequest));
+    if (!request) { return OTP_ERR_IO; }
+
+    request->key = key;
+    request->keyLength = keyLength;
+    request->input = input;
+    request->length = length;
+    request->output = output;
+    request->outputCapacity = outputCapacity;
+    request->callback = callback;
+    request->userData = userData;
+    request->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) { pool->tail->next = request; }
+    else { pool->head = request; }
+    pool->tail = request;
+    pthread_cond_signal(&pool->pending);
+    pthread_mutex_unlock(&pool->lock);
+
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Callback used by futures: store status and wake the waiter
+*******************************************************************************/
+static void completeFuture(int status, void* userData)
+{
+    struct otpFuture* future = userData;
+
+    pthread_mutex_lock(&future->lock);
+    future->status = status;
+    future->finished = 1;
+    pthread_cond_signal(&future->done);
+    pthread_mutex_unlock(&future->lock);
+}
+
+/*******************************************************************************
+ * Queue a request and return a future to wait on, or NULL if not queued
+*******************************************************************************/
+struct otpFuture* otpPoolSubmitFuture(struct otpPool* pool, const char* key, size_t keyLength,
+                                      const char* input, size_t length, char* output, size_t outputCapacity)
+{
+    struct otpFuture* future = malloc(sizeof(struct otpFuture));
+    if (!future) { return NULL; }
+
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->done, NULL);
+    future->finished = 0;
+    future->status = OTP_OK;
+
+    if (otpPoolSubmit(pool, key, keyLength, input, length, output, outputCapacity,
+                      completeFuture, future) != OTP_OK) {
+        free(future);
+        return NULL;
+    }
+    return future;
+}
+
+/*******************************************************************************
+ * Block until the request behind future completes; return its status
+ * and free the future
+*******************************************************************************/
+int otpFutureWait(struct otpFuture* future)
+{
+    pthread_mutex_lock(&future->lock);
+    while (!future->finished) {
+        pthread_cond_wait(&future->done, &future->lock);
+    }
+    int status = future->status;
+    pthread_mutex_unlock(&future->lock);
+
+    pthread_mutex_destroy(&future->lock);
+    pthread_cond_destroy(&future->done);
+    free(future);
+    return status;
+}
+
+/*******************************************************************************
+ * Finish every queued request, then close all connections and free the pool
+*******************************************************************************/
+void otpPoolDestroy(struct otpPool* pool)
+{
+    if (!pool) { return; }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = 1;
+    pthread_cond_broadcast(&pool->pending);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->size; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->pending);
+    free(pool->workers);
+    free(pool->connections);
+    free(pool->host);
+    free(pool);
+}
@@ -0,0 +1,163 @@
+/******************************************************************************
+ * libotp - embeddable One-Time Pad encryption library
+ * Source file defines the send path shared by clients and daemons:
+ *   a frame (optional header, payload, terminator) goes out in one
+ *   sendmsg from the caller's buffers, with no copy to append "@@"
+ *   partial writes are resumed where they stopped
+ *   large payloads use MSG_ZEROCOPY where the kernel supports it
+*******************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include "libotp.h"
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_ZEROCOPY 1
+#endif
+
+/*******************************************************************************
+ * Send all length bytes, retrying short writes and interrupted calls
+*******************************************************************************/
+int otpSendAll(int socketFD, const char* buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t charsWritten = send(socketFD, buffer, length, MSG_NOSIGNAL);
+        if (charsWritten < 0) {
+            if (errno == EINTR) { continue; }
+            return OTP_ERR_IO;
+        }
+        buffer += charsWritten;
+        length -= (size_t)charsWritten;
+    }
+    return OTP_OK;
+}
+
+/*******************************************************************************
+ * Skip passed-in count of sent bytes in message's iovec array
+*******************************************************************************/
+static void advanceMessage(struct msghdr* message, size_t sent)
+{
+    while (message->msg_iovlen > 0 && sent >= message->msg_iov[0].iov_len) {
+        sent -= message->msg_iov[0].iov_len;
+        message->msg_iov++;
+        message->msg_iovlen--;
+    }
+    if (message->msg_iovlen > 0) {
+        message->msg_iov[0].iov_base = (char*)message->msg_iov[0].iov_base + sent;
+        message->msg_iov[0].iov_len -= sent;
+    }
+}
+
+#ifdef HAVE_ZEROCOPY
+/*******************************************************************************
+ * Wait until the kernel reports passed-in count of zerocopy sends complete
+ * Only then may the caller reuse or free the payload buffer
+*******************************************************************************/
+static int waitZeroCopy(int socketFD, unsigned int expected)
+{
+    unsigned int completed = 0;
+
+    while (completed < expected) {
+        char control[128];
+        struct msghdr notification;
+        memset(&notification, 0, sizeof(notification));
+        notification.msg_control = control;
+        notification.msg_controllen = sizeof(control);
+
+        if (recvmsg(socketFD, &notification, MSG_ERRQUEUE) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { return OTP_ERR_IO; }
+
+            // Completions are signalled as POLLERR on the socket; a peer that
+            // hung up with none queued will never send more
+            struct pollfd errorQueue = { .fd = socketFD, .events = 0 };
+            if (poll(&errorQueue, 1, -1) < 0) {
+                if (errno == EINTR) { continue; }
+                return OTP_ERR_IO;
+            }
+            if ((errorQueue.revents & POLLNVAL) ||
+                ((errorQueue.revents & POLLHUP) && !(errorQueue.revents & POLLERR))) { return OTP_ERR_IO; }
+            continue;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&notification); cmsg; cmsg = CMSG_NXTHDR(&notification, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) { continue; }
+
+            struct sock_extended_err* extendedError = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (extendedError->ee_errno == 0 && extendedError->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                completed += extendedError->ee_data - extendedError->ee_info + 1;    // Inclusive id range
+            }
+        }
+    }
+
+    return OTP_OK;
+}
+#endif
+
+/*******************************************************************************
+ * Send header (may be NULL), length bytes of payload and the terminator
+ * as one gathered write straight from the caller's buffers
+ * Payloads of OTP_ZEROCOPY_THRESHOLD bytes or more are sent with
+ * MSG_ZEROCOPY when available; this returns only after the kernel has
+ * released the payload, so the caller may free it immediately
+*******************************************************************************/
+int otpSendFrame(int socketFD, const char* header, size_t headerLength,
+                 const char* payload, size_t length)
+{
+    struct iovec parts[3];
+    struct msghdr message;
+    int numParts = 0;
+    int flags = MSG_NOSIGNAL;
+    unsigned int zeroCopySends = 0;
+
+    if (header && headerLength > 0) {
+        parts[numParts].iov_base = (void*)header;
+        parts[numParts++].iov_len = headerLength;
+    }
+    parts[numParts].iov_base = (void*)payload;
+    parts[numParts++].iov_len = length;
+    parts[numParts].iov_base = (void*)OTP_TERMINATOR;
+    parts[numParts++].iov_len = strlen(OTP_TERMINATOR);
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = (size_t)numParts;
+
+#ifdef HAVE_ZEROCOPY
+    int one = 1;
+    if (length >= OTP_ZEROCOPY_THRESHOLD &&
+        setsockopt(socketFD, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+        flags |= MSG_ZEROCOPY;
+    }
+#endif
+
+    while (message.msg_iovlen > 0) {
+        ssize_t charsWritten = sendmsg(socketFD, &message, flags);
+        if (charsWritten < 0) {
+            if (errno == EINTR) { continue; }
+#ifdef HAVE_ZEROCOPY
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {      // Out of pinned-page budget: copy instead
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+#endif
+            return OTP_ERR_IO;
+        }
+
+#ifdef HAVE_ZEROCOPY
+        if (flags & MSG_ZEROCOPY) { zeroCopySends++; }
+#endif
+        advanceMessage(&message, (size_t)charsWritten);
+    }
+
+#ifdef HAVE_ZEROCOPY
+    if (zeroCopySends > 0) { return waitZeroCopy(socketFD, zeroCopySends); }
+#endif
+    return OTP_OK;
+}
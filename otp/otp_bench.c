@@ -0,0 +1,210 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for otp_bench, a microbenchmark of the transform kernels
+ *   runs each kernel over message sizes from 16 B up to -m bytes
+ *   (default 1 GiB), growing 4x per step
+ *   repeats each run until it lasts at least -t seconds
+ *   reports GB/s and cycles/byte (TSC reference cycles on x86)
+ * The reference kernel is the original modulo arithmetic, for comparison
+ * The key index kernels use a different key offset on every call, so each
+ * one fingerprints fresh windows as a daemon would for a new key
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "otp_helpers.h"
+#include "otp_reference.h"
+#include "otp_keyindex.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define BENCH_MIN_SIZE 16
+#define KEY_SHIFT_RANGE 65536           // Key offsets the key index kernels cycle through
+#define KEY_SHIFT_STEP 4099             // Coprime to the range, so every offset is visited
+
+static char *key, *message, *output;
+static volatile unsigned long long sink;   // Keeps results from being optimized away
+static size_t keyShift = 0;
+
+static void runReferenceCheck(size_t length) { sink += referenceCheckChars(message, length); }
+static void runCheckChars(size_t length) { sink += checkChars(message); }
+static void runOtpCheckChars(size_t length) { sink += otpCheckChars(message, length); }
+static void runOtpCheckCharsChecksum(size_t length)
+{
+    uint32_t checksum;
+    sink += otpCheckCharsChecksum(message, length, &checksum) + checksum;
+}
+static void runCrc32c(size_t length) { sink += otpCrc32c(0, message, length); }
+static void runReferenceTransform(size_t length) { referenceTransform('E', key, message, length, output); sink += output[0]; }
+static void runTransformMessage(size_t length)
+{
+    char* result = transformMessage(key, message, 'E');
+    sink += result[0];
+    free(result);
+}
+static void runOtpEncrypt(size_t length) { sink += otpTransform('E', key, length, message, length, output, length + 1); }
+static void runOtpDecrypt(size_t length) { sink += otpTransform('D', key, length, message, length, output, length + 1); }
+static void runOtpTransformChecksum(size_t length)
+{
+    uint32_t checksum;
+    sink += otpTransformChecksum('E', key, length, message, length, output, length + 1, &checksum) + checksum;
+}
+static const char* nextShiftedKey()
+{
+    keyShift = (keyShift + KEY_SHIFT_STEP) % KEY_SHIFT_RANGE;
+    return key + keyShift;
+}
+static void runKeyIndex(size_t length) { sink += indexKeyWindows('E', nextShiftedKey(), message, length); }
+static void runOtpEncryptIndexed(size_t length)
+{
+    const char* shiftedKey = nextShiftedKey();
+    sink += otpTransform('E', shiftedKey, length, message, length, output, length + 1);
+    sink += indexKeyWindows('E', shiftedKey, message, length);
+}
+
+struct benchKernel {
+    const char* name;
+    void (*run)(size_t length);
+};
+
+static const struct benchKernel kernels[] = {
+    { "reference_check",        runReferenceCheck },
+    { "checkChars",             runCheckChars },
+    { "otpCheckChars",          runOtpCheckChars },
+    { "otpCheckCharsChecksum",  runOtpCheckCharsChecksum },
+    { "otpCrc32c",              runCrc32c },
+    { "reference_transform",    runReferenceTransform },
+    { "transformMessage",       runTransformMessage },
+    { "otpTransform_encrypt",   runOtpEncrypt },
+    { "otpTransform_decrypt",   runOtpDecrypt },
+    { "otpTransformChecksum",   runOtpTransformChecksum },
+    { "keyIndex",               runKeyIndex },
+    { "otpTransform+keyIndex",  runOtpEncryptIndexed },
+};
+
+/******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void usage(char *program)
+{
+    fprintf(stderr, "USAGE: %s [-m maxBytes] [-t minSeconds] [-k kernel]\n", program);
+    exit(1);
+}
+
+/******************************************************************************
+ * Returns the TSC, or 0 where there is none
+*******************************************************************************/
+static unsigned long long readCycles()
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/******************************************************************************
+ * Format passed-in size with a binary unit into passed-in buffer
+*******************************************************************************/
+static const char* formatSize(size_t size, char *buffer, size_t bufferSize)
+{
+    const char *units[] = { "B", "KiB", "MiB", "GiB" };
+    int unit = 0;
+
+    while (size >= 1024 && size % 1024 == 0 && unit < 3) { size /= 1024; unit++; }
+    snprintf(buffer, bufferSize, "%zu%s", size, units[unit]);
+    return buffer;
+}
+
+/******************************************************************************
+ * Time passed-in kernel on length symbols, raising the iteration count
+ * until one batch lasts minNanos, and print its throughput
+*******************************************************************************/
+static void benchKernel(const struct benchKernel *kernel, size_t length, unsigned long long minNanos)
+{
+    unsigned long long iterations = 1, elapsed = 0, cycles = 0;
+    char sizeName[32];
+
+    // Null-terminate at length for the kernels that take C strings
+    message[length] = '\0';
+    key[length] = '\0';
+
+    while (1) {
+        unsigned long long startCycles = readCycles();
+        unsigned long long start = monotonicNanos();
+        for (unsigned long long i = 0; i < iterations; i++) { kernel->run(length); }
+        elapsed = monotonicNanos() - start;
+        cycles = readCycles() - startCycles;
+
+        if (elapsed >= minNanos) { break; }
+        iterations *= elapsed ? minNanos / elapsed + 1 : 1024;           // Aim just past minNanos
+    }
+
+    double bytes = (double)length * (double)iterations;
+    printf("%-24s %8s %10.3f GB/s", kernel->name, formatSize(length, sizeName, sizeof(sizeName)), bytes / (double)elapsed);
+#ifdef HAVE_TSC
+    printf(" %8.3f cycles/B", (double)cycles / bytes);
+#endif
+    printf("\n");
+    fflush(stdout);
+
+    message[length] = keyChars[length % NUM_CHAR_CHOICES];
+    key[length] = keyChars[(length * 7) % NUM_CHAR_CHOICES];
+}
+
+int main(int argc, char *argv[])
+{
+    int option = -5;
+    size_t maxBytes = (size_t)1 << 30;
+    double minSeconds = 0.2;
+    const char *kernelFilter = NULL;
+
+    while ((option = getopt(argc, argv, "m:t:k:")) != -1) {
+        switch (option) {
+            case 'm': maxBytes = (size_t)strtoull(optarg, NULL, 10); break;
+            case 't': minSeconds = atof(optarg); break;
+            case 'k': kernelFilter = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || maxBytes < BENCH_MIN_SIZE || minSeconds <= 0) { usage(argv[0]); }
+
+    key = malloc(maxBytes + KEY_SHIFT_RANGE + 1);
+    message = malloc(maxBytes + 1);
+    output = malloc(maxBytes + 1);
+    if (!key || !message || !output) {
+        fprintf(stderr, "otp_bench: cannot allocate 3 x %zu bytes; lower -m\n", maxBytes + 1);
+        exit(1);
+    }
+
+    // Random valid symbols, touched once so page faults stay out of the timings
+    unsigned int seed = 1;
+    for (size_t i = 0; i <= maxBytes; i++) {
+        key[i] = keyChars[rand_r(&seed) % NUM_CHAR_CHOICES];
+        message[i] = keyChars[rand_r(&seed) % NUM_CHAR_CHOICES];
+    }
+    for (size_t i = maxBytes + 1; i <= maxBytes + KEY_SHIFT_RANGE; i++) {
+        key[i] = keyChars[rand_r(&seed) % NUM_CHAR_CHOICES];
+    }
+    initKeyIndex();
+    memset(output, 0, maxBytes + 1);
+
+    unsigned long long minNanos = (unsigned long long)(minSeconds * 1e9);
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (kernelFilter && !strstr(kernels[k].name, kernelFilter)) { continue; }
+
+        for (size_t length = BENCH_MIN_SIZE; length <= maxBytes; length *= 4) {
+            benchKernel(&kernels[k], length, minNanos);
+        }
+    }
+
+    free(key);
+    free(message);
+    free(output);
+    return 0;
+}
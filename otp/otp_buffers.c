@@ -0,0 +1,175 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the message buffer pool used by the otp daemons
+ * When explicit huge pages are reserved, the arena is mapped shared from
+ * them and touched before any worker is forked: fork copies hugetlb page
+ * tables, so a worker writing into its slot takes no fault at all
+ * Otherwise each worker maps a private arena aligned for transparent huge
+ * pages, faulted in 2 MiB at a time on first use; a shared arena of small
+ * pages would instead be faulted in page by page in every worker
+ * Within an arena, buffers are bump-allocated by size class and kept on
+ * per-class free lists when released, never returned to the kernel
+*******************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "otp_buffers.h"
+#include "otp_metrics.h"
+
+#define HUGE_PAGE_SIZE (2u << 20)
+
+int bufferSlots = BUFFER_DEFAULT_SLOTS;
+
+static char* sharedArena = NULL;        // bufferSlots * BUFFER_SLOT_SIZE bytes
+static pid_t* slotOwners = NULL;        // Shared; 0 marks a free slot
+static int mySlot = -1;
+
+// This worker's arena: its shared slot or a private mapping
+static char* arena = NULL;
+static size_t arenaUsed = 0;
+static char* freeLists[NUM_BUFFER_CLASSES];
+
+/*******************************************************************************
+ * Map passed-in size of private anonymous memory aligned to a huge page
+ * Explicit huge pages are tried first, then transparent ones are requested
+*******************************************************************************/
+static char* mapPrivateArena(size_t size)
+{
+    char* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) { return region; }
+
+    // Over-map so an aligned range can be kept; only aligned 2 MiB ranges become huge pages
+    region = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) { return NULL; }
+
+    char* aligned = (char*)(((uintptr_t)region + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned > region) { munmap(region, (size_t)(aligned - region)); }
+    munmap(aligned + size, (size_t)(region + HUGE_PAGE_SIZE - aligned));
+
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+}
+
+/*******************************************************************************
+ * Map and pre-fault the shared arena before any worker is forked
+ * Without reserved huge pages there are no shared slots
+*******************************************************************************/
+void initBufferPool()
+{
+    size_t arenaSize = (size_t)bufferSlots * BUFFER_SLOT_SIZE;
+
+    if (bufferSlots <= 0) { return; }
+
+    sharedArena = mmap(NULL, arenaSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (sharedArena == MAP_FAILED) {
+        sharedArena = NULL;
+        bufferSlots = 0;
+        return;
+    }
+
+    slotOwners = mmap(NULL, (size_t)bufferSlots * sizeof(pid_t), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (slotOwners == MAP_FAILED) { error("buffers: ERROR mapping shared memory"); }
+    memset(slotOwners, 0, (size_t)bufferSlots * sizeof(pid_t));
+
+    // Touch every huge page now so workers inherit them mapped
+    for (size_t offset = 0; offset < arenaSize; offset += HUGE_PAGE_SIZE) {
+        sharedArena[offset] = '\0';
+    }
+}
+
+/*******************************************************************************
+ * Give the calling worker's slot back when it exits
+*******************************************************************************/
+static void releaseBufferSlot()
+{
+    if (mySlot >= 0) { __atomic_store_n(&slotOwners[mySlot], 0, __ATOMIC_RELEASE); }
+}
+
+/*******************************************************************************
+ * Take a free slot of the shared arena for the calling worker, reclaiming
+ * slots of workers that were killed; otherwise map a private arena
+*******************************************************************************/
+void claimBufferSlot()
+{
+    pid_t me = getpid();
+
+    memset(freeLists, 0, sizeof(freeLists));
+    arenaUsed = 0;
+
+    for (int slot = 0; slot < bufferSlots && mySlot < 0; slot++) {
+        pid_t owner = __atomic_load_n(&slotOwners[slot], __ATOMIC_ACQUIRE);
+        if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) { continue; }     // Held by a live worker
+
+        if (__atomic_compare_exchange_n(&slotOwners[slot], &owner, me, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            mySlot = slot;
+            arena = sharedArena + (size_t)slot * BUFFER_SLOT_SIZE;
+            atexit(releaseBufferSlot);
+        }
+    }
+
+    if (mySlot < 0) {
+        if (bufferSlots > 0) { countMetric(MC_BUFFER_FALLBACKS, 1); }     // Every shared slot busy
+        arena = mapPrivateArena(BUFFER_SLOT_SIZE);
+    }
+}
+
+/*******************************************************************************
+ * Returns the size class index for passed-in size, NUM_BUFFER_CLASSES if none
+*******************************************************************************/
+static int sizeClassOf(size_t size, size_t* classSize)
+{
+    int sizeClass = 0;
+
+    *classSize = BUFFER_MIN_CLASS;
+    while (*classSize < size && sizeClass < NUM_BUFFER_CLASSES) {
+        *classSize <<= 2;
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+/*******************************************************************************
+ * Return a buffer of at least passed-in size, reusing a freed one of its
+ * class if there is one, else carving a new one from the arena
+ * Buffers beyond the largest class, or beyond the arena, come from malloc
+*******************************************************************************/
+char* poolAlloc(size_t size)
+{
+    size_t classSize;
+    int sizeClass = sizeClassOf(size, &classSize);
+    char* buffer;
+
+    if (sizeClass == NUM_BUFFER_CLASSES) { buffer = malloc(size); }
+    else if (freeLists[sizeClass]) {
+        buffer = freeLists[sizeClass];
+        memcpy(&freeLists[sizeClass], buffer, sizeof(char*));             // Next link lives in the buffer
+    }
+    else if (arena && arenaUsed + classSize <= BUFFER_SLOT_SIZE) {
+        buffer = arena + arenaUsed;
+        arenaUsed += classSize;
+    }
+    else { buffer = malloc(classSize); }
+
+    if (!buffer) { error("poolAlloc"); }
+    return buffer;
+}
+
+/*******************************************************************************
+ * Put a buffer from poolAlloc of passed-in size on its class's free list
+*******************************************************************************/
+void poolFree(char* buffer, size_t size)
+{
+    size_t classSize;
+    int sizeClass = sizeClassOf(size, &classSize);
+
+    if (!buffer) { return; }
+    if (sizeClass == NUM_BUFFER_CLASSES) { free(buffer); return; }
+
+    memcpy(buffer, &freeLists[sizeClass], sizeof(char*));
+    freeLists[sizeClass] = buffer;
+}
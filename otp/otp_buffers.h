@@ -0,0 +1,29 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the message buffer pool used by the otp daemons:
+ *   a shared arena of reserved huge pages, pre-faulted at startup and cut
+ *   into per-worker slots, or else a private arena per worker aligned
+ *   for transparent huge pages
+ *   each worker carves power-of-4 size classes from its slot and reuses
+ *   freed buffers, so steady-state requests neither allocate nor fault
+*******************************************************************************/
+
+#ifndef OTP_BUFFERS_H
+#define OTP_BUFFERS_H
+
+#include <stddef.h>
+#include "otp_helpers.h"
+
+#define BUFFER_SLOT_SIZE (4u << 20)     // Two 2 MiB huge pages: key, message and reply buffers
+#define BUFFER_DEFAULT_SLOTS 8
+#define BUFFER_MIN_CLASS 4096
+#define NUM_BUFFER_CLASSES 6            // 4 KiB, 16 KiB ... 4 MiB
+
+extern int bufferSlots;
+
+void initBufferPool();
+void claimBufferSlot();
+char* poolAlloc(size_t size);
+void poolFree(char* buffer, size_t size);
+
+#endif //OTP_BUFFERS_H
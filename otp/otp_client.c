@@ -0,0 +1,198 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the client side shared by otp_enc and otp_dec
+ *   validates key and message input
+ *   connects to the matching daemon through libotp
+ *   sends message and prints returned transformation to stdout
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "otp_client.h"
+#include "otp_timing.h"
+#include "otp_compress.h"
+
+const char* clientName = "otp";
+const char* daemonName = "otp_d";
+
+static char* keyText = NULL;
+static char* messageText = NULL;
+static bool compressMessages = false;
+
+/******************************************************************************
+ * Replace the plaintext with its packed form, so the key need only be
+ * as long as the packing
+ * The plaintext is checked first, since its packing is always valid
+*******************************************************************************/
+static void packInput()
+{
+    size_t length = strlen(messageText);
+
+    if (checkChars(messageText) == false) {
+        fprintf(stderr, "%s error: input contains bad characters\n", clientName);
+        exit(1);
+    }
+
+    char* packed = packMessage(messageText, length);
+    if (timingToStderr) {
+        fprintf(stderr, "%s: packed %zu symbols into %zu\n", clientName, length, strlen(packed));
+    }
+
+    free(messageText);
+    messageText = packed;
+}
+
+/******************************************************************************
+ * Parse options and arguments, read and validate the input files,
+ * then have the daemon transform the message
+ * If message or key is "-" (stdin) or a FIFO, stream it instead
+ *   -t        print per-stage timing to stderr
+ *   -j path   append per-stage timing to path as a JSON line
+ *   -z        compressed mode: otp_enc packs the plaintext before sending,
+ *             otp_dec unpacks what it decrypts (see otp_compress.c)
+*******************************************************************************/
+int runClient(int argc, char *argv[])
+{
+    int option = -5;
+
+    // Parse timing options
+    while ((option = getopt(argc, argv, "tj:z")) != -1) {
+        switch (option) {
+            case 't': timingToStderr = true; break;             // Print stage breakdown to stderr
+            case 'j': timingJSONPath = optarg; break;           // Append stage breakdown as JSON line
+            case 'z': compressMessages = true; break;           // Pack/unpack around the transform
+            default:
+                fprintf(stderr,"USAGE: %s [-t] [-j timing.jsonl] [-z] message|- key|- port\n", argv[0]);
+                exit(0);
+        }
+    }
+
+    // Check for 3 remaining arguments, 3rd should be non-negative port number
+    if (argc - optind != 3 || atoi(argv[optind + 2]) < 0) {
+        fprintf(stderr,"USAGE: %s [-t] [-j timing.jsonl] [-z] message|- key|- port\n", argv[0]);
+        exit(0);
+    }
+
+    // Save args
+    char* messageFile = argv[optind];
+    char* keyFile = argv[optind + 1];
+    int portNumber = atoi(argv[optind + 2]);
+    startTiming();
+
+    // Stream with bounded memory if either input may be unbounded
+    if (isStreamArgument(messageFile) || isStreamArgument(keyFile)) {
+        if (compressMessages) {
+            fprintf(stderr, "%s: ERROR -z needs the whole message and cannot stream\n", clientName);
+            exit(1);
+        }
+        streamConnection(portNumber, messageFile, keyFile);
+        return 0;
+    }
+
+    // Read files and check for valid input
+    keyText = readFile(keyFile);
+    markStage(STAGE_READ_KEY);
+    messageText = readFile(messageFile);
+    markStage(STAGE_READ_TEXT);
+    if (compressMessages && programID == OTP_ENCRYPT) { packInput(); }
+    validateInput(keyFile, keyText, messageText);
+    markStage(STAGE_VALIDATE);
+
+    // Create the connection
+    createConnection(portNumber);
+
+    // Report stage timing if requested
+    reportTiming(clientName, strlen(messageText));
+
+    // Free memory
+    free(keyText);
+    free(messageText);
+
+    return 0;
+}
+
+/******************************************************************************
+ * Check that passed-in keyText is at least as long as passed-in messageText
+ * Check that both contain valid characters (as defined in keyChars array)
+ * Exit with error value 1 if not
+*******************************************************************************/
+void validateInput(char *keyFile, char *keyText, char *messageText)
+{
+    // Check that key length is >= message length
+    if (strlen(keyText) < strlen(messageText)) {
+        fprintf(stderr, "Error: key '%s' is too short\n", keyFile);
+        exit(1);
+    }
+
+    // Check that key and message contain valid characters
+    if (checkChars(keyText) == false || checkChars(messageText) == false)  {
+        fprintf(stderr, "%s error: input contains bad characters\n", clientName);
+        exit(1);
+    }
+}
+
+/******************************************************************************
+ * Connect to the daemon on passed-in port and validate the connection
+ * Send keyText and messageText, receive the transformed text
+ * straight into an output buffer and print it to stdout
+ * Exit with error value 2 if the daemon does not serve this programID
+*******************************************************************************/
+void createConnection(int portNumber)
+{
+    struct otpConnection* connection = NULL;
+    size_t length = strlen(messageText);
+
+    // Connect and check connected to the matching daemon ONLY
+    otpSetStageHook(timingEnabled ? markLibraryStage : NULL);
+    int status = otpConnect("localhost", portNumber, programID, &connection);
+    switch (status) {
+        case OTP_OK:
+            break;
+
+        case OTP_ERR_RESOLVE:
+            fprintf(stderr, "%s: ERROR, no such host\n", clientName);
+            exit(0);
+
+        case OTP_ERR_CONNECT:
+            fprintf(stderr, "%s: ERROR connecting to %s: %s\n", clientName, daemonName, strerror(errno));
+            exit(0);
+
+        case OTP_ERR_HANDSHAKE:
+            fprintf(stderr, "Error: could not contact %s on port %d\n", daemonName, portNumber);
+            exit(2);
+
+        default:
+            fprintf(stderr, "%s: ERROR %s\n", clientName, otpStatusString(status));
+            exit(1);
+    }
+
+    // Send key text and message to server, receive transformed message
+    char* transformedText = malloc(length + 1);
+    if (!transformedText) { error("malloc"); }
+
+    status = otpRemoteTransform(connection, keyText, strlen(keyText), messageText, length,
+                                transformedText, length + 1);
+    if (status != OTP_OK) {
+        fprintf(stderr, "%s: ERROR %s\n", clientName, otpStatusString(status));
+        exit(1);
+    }
+
+    // Unpack what was decrypted in compressed mode
+    if (compressMessages && programID == OTP_DECRYPT) {
+        char* text = unpackMessage(transformedText, length);
+        if (!text) {
+            fprintf(stderr, "%s: ERROR message was not sent with -z, or the key is wrong\n", clientName);
+            exit(1);
+        }
+        free(transformedText);
+        transformedText = text;
+    }
+
+    // Send to stdout and close the connection
+    printf("%s\n", transformedText);
+
+    free(transformedText);
+    otpClose(connection);
+}
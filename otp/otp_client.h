@@ -0,0 +1,21 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the client-side functions shared by otp_enc and
+ * otp_dec, which differ only in the programID they send
+*******************************************************************************/
+
+#ifndef OTP_CLIENT_H
+#define OTP_CLIENT_H
+
+#include "otp_helpers.h"
+
+extern const char* clientName;
+extern const char* daemonName;
+
+int runClient(int argc, char *argv[]);
+void validateInput(char *keyFile, char *keyText, char *messageText);
+void createConnection(int portNumber);
+bool isStreamArgument(const char *path);
+void streamConnection(int portNumber, char *messageFile, char *keyFile);
+
+#endif //OTP_CLIENT_H
@@ -0,0 +1,181 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the compressed mode of otp_enc and otp_dec
+ * A packed message is one marker symbol, then either the text verbatim or:
+ *   the text length as a little-endian base-128 varint
+ *   the text deflated by zlib (whose adler32 catches a wrong key)
+ * with those bytes written in base 27, 7 bytes to a 12-symbol group
+ * (27^12 > 2^56) and a shorter group for the last 1-6 bytes
+ * A symbol holds log2(27) = 4.75 bits, so text must deflate to less than
+ * 4.75 bits a character to save anything; English prose gets about 2.5
+*******************************************************************************/
+
+#include <stdint.h>
+#include <zlib.h>
+#include "otp_compress.h"
+
+#define GROUP_BYTES 7
+#define GROUP_SYMBOLS 12
+#define MAX_VARINT_BYTES 10
+#define MAX_DEFLATE_RATIO 1032          // zlib never expands more than this
+
+// Fewest symbols that can hold each number of trailing bytes
+static const int tailSymbols[GROUP_BYTES] = { 0, 2, 4, 6, 7, 9, 11 };
+
+/*******************************************************************************
+ * Returns the number of symbols passed-in number of bytes is written in
+*******************************************************************************/
+static size_t symbolsForBytes(size_t numBytes)
+{
+    return numBytes / GROUP_BYTES * GROUP_SYMBOLS + (size_t)tailSymbols[numBytes % GROUP_BYTES];
+}
+
+/*******************************************************************************
+ * Write passed-in bytes in base 27, most significant symbol first
+*******************************************************************************/
+static void encodeSymbols(const unsigned char* bytes, size_t numBytes, char* symbols)
+{
+    while (numBytes > 0) {
+        size_t groupBytes = numBytes < GROUP_BYTES ? numBytes : GROUP_BYTES;
+        int groupSymbols = groupBytes == GROUP_BYTES ? GROUP_SYMBOLS : tailSymbols[groupBytes];
+        uint64_t value = 0;
+
+        for (size_t i = 0; i < groupBytes; i++) { value = value << 8 | bytes[i]; }
+        for (int i = groupSymbols - 1; i >= 0; i--) {
+            symbols[i] = keyChars[value % NUM_CHAR_CHOICES];
+            value /= NUM_CHAR_CHOICES;
+        }
+
+        bytes += groupBytes;
+        numBytes -= groupBytes;
+        symbols += groupSymbols;
+    }
+}
+
+/*******************************************************************************
+ * Read passed-in symbols back into bytes, which must hold
+ * numSymbols * GROUP_BYTES / GROUP_SYMBOLS + GROUP_BYTES
+ * Returns the number of bytes, or -1 if the symbols cannot be a packing
+*******************************************************************************/
+static long decodeSymbols(const char* symbols, size_t numSymbols, unsigned char* bytes)
+{
+    long numBytes = 0;
+
+    while (numSymbols > 0) {
+        int groupBytes = GROUP_BYTES;
+        int groupSymbols = GROUP_SYMBOLS;
+        uint64_t value = 0;
+
+        // A short last group has its own symbol count, one per byte count
+        if (numSymbols < GROUP_SYMBOLS) {
+            for (groupBytes = 1; groupBytes < GROUP_BYTES && tailSymbols[groupBytes] != (int)numSymbols; groupBytes++);
+            if (groupBytes == GROUP_BYTES) { return -1; }
+            groupSymbols = (int)numSymbols;
+        }
+
+        for (int i = 0; i < groupSymbols; i++) {
+            value = value * NUM_CHAR_CHOICES + (uint64_t)(symbols[i] == ' ' ? 26 : symbols[i] - 'A');
+        }
+        if (value >> (8 * groupBytes)) { return -1; }                    // More than the bytes could hold
+
+        for (int i = groupBytes - 1; i >= 0; i--) {
+            bytes[numBytes + i] = (unsigned char)value;
+            value >>= 8;
+        }
+
+        numBytes += groupBytes;
+        symbols += groupSymbols;
+        numSymbols -= (size_t)groupSymbols;
+    }
+
+    return numBytes;
+}
+
+/*******************************************************************************
+ * Pack passed-in text of valid symbols for sending in compressed mode
+ * Returns the packed message, allocated for the caller to free
+*******************************************************************************/
+char* packMessage(const char* text, size_t length)
+{
+    uLongf deflatedLength = compressBound(length);
+    unsigned char* bytes = malloc(MAX_VARINT_BYTES + deflatedLength);
+    if (!bytes) { error("malloc"); }
+
+    size_t headerLength = 0;
+    for (size_t remaining = length; ; remaining >>= 7) {
+        bytes[headerLength++] = (unsigned char)((remaining & 0x7f) | (remaining > 0x7f ? 0x80 : 0));
+        if (remaining <= 0x7f) { break; }
+    }
+
+    if (compress2(bytes + headerLength, &deflatedLength, (const Bytef*)text, length, Z_BEST_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Error: could not compress message\n");
+        exit(1);
+    }
+
+    // Short or random text can come out longer; send it as it is then
+    size_t numSymbols = symbolsForBytes(headerLength + deflatedLength);
+    bool deflated = numSymbols < length;
+    if (!deflated) { numSymbols = length; }
+
+    char* packed = malloc(numSymbols + 2);
+    if (!packed) { error("malloc"); }
+
+    packed[0] = deflated ? PACK_DEFLATED : PACK_VERBATIM;
+    if (deflated) { encodeSymbols(bytes, headerLength + deflatedLength, packed + 1); }
+    else { memcpy(packed + 1, text, length); }
+    packed[numSymbols + 1] = '\0';
+
+    free(bytes);
+    return packed;
+}
+
+/*******************************************************************************
+ * Unpack passed-in decrypted message of valid symbols
+ * Returns the original text, allocated for the caller to free,
+ * or NULL if the message was not packed (or was decrypted with the wrong key)
+*******************************************************************************/
+char* unpackMessage(const char* symbols, size_t length)
+{
+    if (length == 0) { return NULL; }
+
+    if (symbols[0] == PACK_VERBATIM) {
+        char* text = malloc(length);
+        if (!text) { error("malloc"); }
+        memcpy(text, symbols + 1, length - 1);
+        text[length - 1] = '\0';
+        return text;
+    }
+    if (symbols[0] != PACK_DEFLATED) { return NULL; }
+
+    unsigned char* bytes = malloc((length - 1) / GROUP_SYMBOLS * GROUP_BYTES + GROUP_BYTES);
+    if (!bytes) { error("malloc"); }
+
+    long numBytes = decodeSymbols(symbols + 1, length - 1, bytes);
+    char* text = NULL;
+
+    // Text length, then the deflated text
+    size_t textLength = 0, headerLength = 0;
+    int shift = 0;
+    while (numBytes > 0 && headerLength < MAX_VARINT_BYTES && headerLength < (size_t)numBytes) {
+        textLength |= (size_t)(bytes[headerLength] & 0x7f) << shift;
+        shift += 7;
+        if (!(bytes[headerLength++] & 0x80)) { break; }
+    }
+
+    size_t deflatedLength = numBytes > 0 ? (size_t)numBytes - headerLength : 0;
+    if (deflatedLength > 0 && textLength / MAX_DEFLATE_RATIO <= deflatedLength) {
+        uLongf inflatedLength = textLength;
+        text = malloc(textLength + 1);
+        if (!text) { error("malloc"); }
+
+        if (uncompress((Bytef*)text, &inflatedLength, bytes + headerLength, deflatedLength) != Z_OK ||
+            inflatedLength != textLength || !otpCheckChars(text, textLength)) {
+            free(text);
+            text = NULL;
+        }
+        else { text[textLength] = '\0'; }
+    }
+
+    free(bytes);
+    return text;
+}
@@ -0,0 +1,23 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the compressed mode of otp_enc and otp_dec (-z):
+ *   plaintext is deflated, and the compressed bytes are written back out
+ *   in the pad alphabet, 7 bytes to every 12 symbols
+ *   the result is an ordinary message, so the daemons never know, but it
+ *   burns fewer key symbols and wire bytes than redundant text would
+*******************************************************************************/
+
+#ifndef OTP_COMPRESS_H
+#define OTP_COMPRESS_H
+
+#include <stddef.h>
+#include "otp_helpers.h"
+
+// First symbol of a packed message says how the rest was written
+#define PACK_DEFLATED 'Z'
+#define PACK_VERBATIM 'V'       // Compression would not have saved anything
+
+char* packMessage(const char* text, size_t length);
+char* unpackMessage(const char* symbols, size_t length);
+
+#endif //OTP_COMPRESS_H
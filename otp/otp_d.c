@@ -0,0 +1,30 @@
+/******************************************************************************
+ * Source file for the combined server-side program
+ *   accepts both otp_enc and otp_dec clients on one port
+ *   each connection keeps the mode of its handshake byte ('E' or 'D')
+ *   any other handshake byte is refused, as otp_enc_d/otp_dec_d refuse
+ *   the wrong client
+ *   both modes share one set of workers, transform turns and metrics,
+ *   so capacity goes to whichever direction is busy
+ *   serving logic is shared with otp_enc_d and otp_dec_d in otp_server.c
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "otp_helpers.h"
+#include "otp_server.h"
+
+int main(int argc, char *argv[])
+{
+    // Serve encryption and decryption clients alike
+    programID = SERVE_ANY_MODE;
+    serverName = "otp_d";
+
+    // Check usage & args, save port number
+    int portNumber = parseServerArgs(argc, argv);
+
+    // Begin listening
+    beginListening(portNumber);
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the transform executor of the threaded daemon
+ * Every worker has a queue of tasks under its own lock; it serves its own
+ * queue first and, when that is empty, steals from the others in turn
+ * Both the owner and thieves take the oldest task: tasks are independent
+ * requests, so running the newest first would only add tail latency
+ * An idle worker sets its bit in idleWorkers, looks once more for a task,
+ * then sleeps on its own condition variable; a submitter pushes its task,
+ * then wakes one idle worker, so between them no task is left waiting
+*******************************************************************************/
+
+#include <stdint.h>
+#include <pthread.h>
+#include "otp_executor.h"
+#include "otp_metrics.h"
+
+#define INITIAL_QUEUE_CAPACITY 64
+
+struct taskEntry {
+    executorTask run;
+    void* arg;
+};
+
+// One per worker, on its own cache lines
+struct taskQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool woken;
+    struct taskEntry* entries;          // Ring of capacity entries, oldest at head
+    size_t capacity;
+    size_t head;
+    size_t count;                       // Also read unlocked, to skip empty queues
+} __attribute__((aligned(64)));
+
+static struct taskQueue* queues = NULL;
+static int numWorkers = 0;
+static int metricsSlotBase = 0;
+static uint64_t idleWorkers = 0;        // Bit w set while worker w sleeps or is about to
+static unsigned int nextQueue = 0;
+
+/*******************************************************************************
+ * Append passed-in task to a queue, doubling the ring when it is full
+*******************************************************************************/
+static void pushTask(struct taskQueue* queue, struct taskEntry task)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->count == queue->capacity) {
+        struct taskEntry* entries = malloc(2 * queue->capacity * sizeof(struct taskEntry));
+        if (!entries) { error("malloc"); }
+        for (size_t i = 0; i < queue->count; i++) {
+            entries[i] = queue->entries[(queue->head + i) % queue->capacity];
+        }
+        free(queue->entries);
+        queue->entries = entries;
+        queue->capacity *= 2;
+        queue->head = 0;
+    }
+
+    queue->entries[(queue->head + queue->count) % queue->capacity] = task;
+    __atomic_store_n(&queue->count, queue->count + 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/*******************************************************************************
+ * Take the oldest task of a queue into passed-in task
+ * Returns false, without locking, if the queue looks empty
+*******************************************************************************/
+static bool takeTask(struct taskQueue* queue, struct taskEntry* task)
+{
+    bool taken = false;
+
+    if (__atomic_load_n(&queue->count, __ATOMIC_RELAXED) == 0) { return false; }
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        *task = queue->entries[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        __atomic_store_n(&queue->count, queue->count - 1, __ATOMIC_RELAXED);
+        taken = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return taken;
+}
+
+/*******************************************************************************
+ * Find a task for passed-in worker: its own oldest, else one stolen
+*******************************************************************************/
+static bool findTask(int worker, struct taskEntry* task)
+{
+    for (int i = 0; i < numWorkers; i++) {
+        if (takeTask(&queues[(worker + i) % numWorkers], task)) { return true; }
+    }
+    return false;
+}
+
+/*******************************************************************************
+ * Wake passed-in worker from its sleep
+*******************************************************************************/
+static void wakeWorker(int worker)
+{
+    struct taskQueue* queue = &queues[worker];
+
+    pthread_mutex_lock(&queue->lock);
+    queue->woken = true;
+    pthread_cond_signal(&queue->wake);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/*******************************************************************************
+ * Worker thread: run tasks as long as any can be found, else sleep
+*******************************************************************************/
+static void* runWorker(void* arg)
+{
+    int worker = (int)(intptr_t)arg;
+    uint64_t workerBit = 1ULL << worker;
+    struct taskQueue* queue = &queues[worker];
+    struct taskEntry task;
+
+    claimMetricsSlot(metricsSlotBase + worker);
+
+    while (1) {
+        if (findTask(worker, &task)) {
+            task.run(task.arg);
+            continue;
+        }
+
+        // Advertise idleness before the last look, so a task pushed after it is seen by its submitter;
+        // the fence pairs with submitTask's, as the look's relaxed count loads are not ordered by the RMW alone
+        __atomic_fetch_or(&idleWorkers, workerBit, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (findTask(worker, &task)) {
+            __atomic_fetch_and(&idleWorkers, ~workerBit, __ATOMIC_SEQ_CST);
+            task.run(task.arg);
+            continue;
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        while (!queue->woken) { pthread_cond_wait(&queue->wake, &queue->lock); }
+        queue->woken = false;
+        pthread_mutex_unlock(&queue->lock);
+        __atomic_fetch_and(&idleWorkers, ~workerBit, __ATOMIC_SEQ_CST);
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ * Start passed-in number of worker threads (at most MAX_EXECUTOR_THREADS),
+ * which count their metrics in consecutive slots from firstMetricsSlot
+*******************************************************************************/
+void startExecutor(int numThreads, int firstMetricsSlot)
+{
+    numWorkers = numThreads < 1 ? 1 : numThreads > MAX_EXECUTOR_THREADS ? MAX_EXECUTOR_THREADS : numThreads;
+    metricsSlotBase = firstMetricsSlot;
+
+    queues = calloc((size_t)numWorkers, sizeof(struct taskQueue));
+    if (!queues) { error("calloc"); }
+
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_mutex_init(&queues[w].lock, NULL);
+        pthread_cond_init(&queues[w].wake, NULL);
+        queues[w].capacity = INITIAL_QUEUE_CAPACITY;
+        queues[w].entries = malloc(INITIAL_QUEUE_CAPACITY * sizeof(struct taskEntry));
+        if (!queues[w].entries) { error("malloc"); }
+    }
+
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, runWorker, (void*)(intptr_t)w) != 0) { error("pthread_create"); }
+        pthread_detach(thread);
+    }
+}
+
+/*******************************************************************************
+ * Queue passed-in task, preferring an idle worker's queue so it starts at
+ * once, else the next queue round-robin, then wake an idle worker if any
+*******************************************************************************/
+void submitTask(executorTask run, void* arg)
+{
+    struct taskEntry task = { run, arg };
+    uint64_t idle = __atomic_load_n(&idleWorkers, __ATOMIC_SEQ_CST);
+    int target = idle ? __builtin_ctzll(idle)
+                      : (int)(__atomic_fetch_add(&nextQueue, 1, __ATOMIC_RELAXED) % (unsigned int)numWorkers);
+
+    pushTask(&queues[target], task);
+
+    // Pairs with the idle worker's fetch_or: it sees this task, or this sees its bit
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    idle = __atomic_load_n(&idleWorkers, __ATOMIC_SEQ_CST);
+    while (idle) {
+        uint64_t workerBit = idle & -idle;
+        if (__atomic_fetch_and(&idleWorkers, ~workerBit, __ATOMIC_SEQ_CST) & workerBit) {
+            wakeWorker(__builtin_ctzll(workerBit));
+            break;
+        }
+        idle = __atomic_load_n(&idleWorkers, __ATOMIC_SEQ_CST);
+    }
+}
@@ -0,0 +1,22 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the transform executor of the threaded daemon:
+ *   a fixed pool of worker threads, each with its own task queue
+ *   tasks are handed to an idle worker when there is one, else spread
+ *   round-robin; a worker whose queue is empty steals from the others
+ *   there is no global queue lock, only one lock per worker's queue
+*******************************************************************************/
+
+#ifndef OTP_EXECUTOR_H
+#define OTP_EXECUTOR_H
+
+#include "otp_helpers.h"
+
+#define MAX_EXECUTOR_THREADS 64         // One bit each in the idle mask
+
+typedef void (*executorTask)(void* arg);
+
+void startExecutor(int numThreads, int firstMetricsSlot);
+void submitTask(executorTask run, void* arg);
+
+#endif //OTP_EXECUTOR_H
@@ -0,0 +1,185 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for otp_fuzz, a differential fuzz harness for the kernels
+ * Each case draws a random length (biased to block and page edges),
+ * key and message, sometimes corrupting one character, and checks:
+ *   every character check agrees with the reference on validity
+ *   every transform variant is byte-identical to the reference
+ *   decrypting the encryption gives back the message
+ *   fused checksums equal otpCrc32c over the same bytes
+ *   errors (bad mode, short key, small buffer) are reported, not written
+ * Exits 1 at the first mismatch, printing the seed and case to rerun
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "otp_helpers.h"
+#include "otp_reference.h"
+
+#define FUZZ_CANARY '\x7f'
+
+static unsigned long long caseNumber = 0;
+static unsigned int caseSeed = 0;
+
+/******************************************************************************
+ * Report a mismatch with what is needed to replay it, and exit
+*******************************************************************************/
+static void fail(const char *what, size_t length)
+{
+    fprintf(stderr, "otp_fuzz: MISMATCH in %s: case %llu, seed %u, length %zu\n"
+                    "  rerun with: otp_fuzz -s %u -n 1\n", what, caseNumber, caseSeed, length, caseSeed);
+    exit(1);
+}
+
+/******************************************************************************
+ * Returns a random length up to maxLength; half are near a power of two
+ * or a multiple of 8192 (the fused checksum block), where bugs cluster
+*******************************************************************************/
+static size_t randomLength(unsigned int *seed, size_t maxLength)
+{
+    size_t length;
+
+    switch (rand_r(seed) % 4) {
+        case 0:
+            length = (size_t)1 << (rand_r(seed) % 22);
+            break;
+        case 1:
+            length = 8192 * (size_t)(rand_r(seed) % 64 + 1);
+            break;
+        default:
+            length = (size_t)rand_r(seed) % (maxLength + 1);
+            return length;
+    }
+
+    long long nearEdge = (long long)length + rand_r(seed) % 17 - 8;      // Either side of the edge
+    if (nearEdge < 0) { nearEdge = 0; }
+    return (size_t)nearEdge > maxLength ? maxLength : (size_t)nearEdge;
+}
+
+/******************************************************************************
+ * Run one case; every buffer has one extra byte holding a canary,
+ * so a kernel writing past length is caught too
+*******************************************************************************/
+static void fuzzCase(size_t length, unsigned int *seed, char *key, char *message,
+                     char *expected, char *output, char *roundTrip)
+{
+    for (size_t i = 0; i < length; i++) {
+        key[i] = keyChars[rand_r(seed) % NUM_CHAR_CHOICES];
+        message[i] = keyChars[rand_r(seed) % NUM_CHAR_CHOICES];
+    }
+    key[length] = message[length] = '\0';
+
+    // One case in four has a random byte somewhere in the message
+    if (length > 0 && rand_r(seed) % 4 == 0) {
+        char corrupt = (char)(rand_r(seed) % 255 + 1);                  // Never '\0', so strlen still works
+        message[(size_t)rand_r(seed) % length] = corrupt;
+    }
+
+    // Character checks must agree with the reference
+    bool valid = referenceCheckChars(message, length);
+    uint32_t checksum = 0;
+    if (!!otpCheckChars(message, length) != valid) { fail("otpCheckChars", length); }
+    if (!!checkChars(message) != valid) { fail("checkChars", length); }
+    if (!!otpCheckCharsChecksum(message, length, &checksum) != valid) { fail("otpCheckCharsChecksum validity", length); }
+    if (checksum != otpCrc32c(0, message, length)) { fail("otpCheckCharsChecksum checksum", length); }
+
+    if (!valid) {
+        output[0] = FUZZ_CANARY;
+        if (length > 0 && otpTransform('E', key, length, message, length, output, length + 1) != OTP_ERR_BAD_CHARS) {
+            fail("otpTransform accepted bad characters", length);
+        }
+        return;
+    }
+
+    for (int m = 0; m < 2; m++) {
+        char mode = m == 0 ? OTP_ENCRYPT : OTP_DECRYPT;
+        referenceTransform(mode, key, message, length, expected);
+
+        memset(output, FUZZ_CANARY, length + 2);
+        if (otpTransform(mode, key, length, message, length, output, length + 1) != OTP_OK ||
+            memcmp(output, expected, length) != 0) { fail("otpTransform", length); }
+        if (output[length + 1] != FUZZ_CANARY) { fail("otpTransform wrote past capacity", length); }
+
+        memset(output, FUZZ_CANARY, length + 2);
+        if (otpTransformChecksum(mode, key, length, message, length, output, length + 1, &checksum) != OTP_OK ||
+            memcmp(output, expected, length) != 0) { fail("otpTransformChecksum", length); }
+        if (checksum != otpCrc32c(0, expected, length)) { fail("otpTransformChecksum checksum", length); }
+
+        // Capacity of exactly length must work too, without a terminator
+        output[length] = FUZZ_CANARY;
+        if (otpTransform(mode, key, length, message, length, output, length) != OTP_OK ||
+            output[length] != FUZZ_CANARY) { fail("otpTransform at exact capacity", length); }
+
+        char *result = transformMessage(key, message, mode);
+        if (!result || memcmp(result, expected, length) != 0 || result[length] != '\0') { fail("transformMessage", length); }
+        free(result);
+    }
+
+    // Round trip: decrypt(encrypt(message)) == message
+    referenceTransform(OTP_ENCRYPT, key, message, length, expected);
+    if (otpTransform(OTP_DECRYPT, key, length, expected, length, roundTrip, length + 1) != OTP_OK ||
+        memcmp(roundTrip, message, length) != 0) { fail("round trip", length); }
+
+    // Errors must be reported, not acted on
+    if (otpTransform('X', key, length, message, length, output, length + 1) != OTP_ERR_MODE) { fail("bad mode", length); }
+    if (length > 0) {
+        if (otpTransform(OTP_ENCRYPT, key, length - 1, message, length, output, length + 1) != OTP_ERR_KEY_SHORT) {
+            fail("short key", length);
+        }
+        if (otpTransform(OTP_ENCRYPT, key, length, message, length, output, length - 1) != OTP_ERR_BUFFER) {
+            fail("small buffer", length);
+        }
+    }
+}
+
+/******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void usage(char *program)
+{
+    fprintf(stderr, "USAGE: %s [-n cases] [-s seed] [-m maxLength]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int option = -5;
+    unsigned long long numCases = 10000;
+    unsigned int seed = 1;
+    size_t maxLength = 1 << 20;
+
+    while ((option = getopt(argc, argv, "n:s:m:")) != -1) {
+        switch (option) {
+            case 'n': numCases = strtoull(optarg, NULL, 10); break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'm': maxLength = (size_t)strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc) { usage(argv[0]); }
+
+    char *key = malloc(maxLength + 2);
+    char *message = malloc(maxLength + 2);
+    char *expected = malloc(maxLength + 2);
+    char *output = malloc(maxLength + 2);
+    char *roundTrip = malloc(maxLength + 2);
+    if (!key || !message || !expected || !output || !roundTrip) { error("malloc"); }
+
+    // Each case is seeded from the run's sequence so any one can be replayed alone
+    for (caseNumber = 0; caseNumber < numCases; caseNumber++) {
+        caseSeed = seed + (unsigned int)caseNumber;
+        unsigned int caseState = caseSeed;
+        fuzzCase(randomLength(&caseState, maxLength), &caseState, key, message, expected, output, roundTrip);
+    }
+
+    printf("otp_fuzz: %llu cases passed (seeds %u-%u)\n", numCases, seed, seed + (unsigned int)numCases - 1);
+
+    free(key);
+    free(message);
+    free(expected);
+    free(output);
+    free(roundTrip);
+    return 0;
+}
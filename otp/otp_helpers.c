@@ -5,10 +5,12 @@
  *   using network sockets
 *******************************************************************************/
 #include <string.h>
+#include <time.h>
 #include <sys/socket.h>
 #include "otp_helpers.h"
 
 const char keyChars[NUM_CHAR_CHOICES] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+char programID = '\0';
 
 /*******************************************************************************
  * Error function used for reporting issues with perror and description
@@ -25,17 +27,7 @@ void error(const char *msg)
 *******************************************************************************/
 bool checkChars(char* input)
 {
-    // Resource: https://stackoverflow.com/questions/10651999/how-can-i-check-if-a-single-char-exists-in-a-c-string
-    int length = (int)strlen(input);
-    int i = -5;
-
-    for (i = 0; i < length-1; i++) {
-        if (!strchr(keyChars, input[i])) {
-            return false;
-        }
-    }
-
-    return true;
+    return otpCheckChars(input, strlen(input));
 }
 
 /*******************************************************************************
@@ -72,52 +64,30 @@ char* readFile(char *fileName)
 /*******************************************************************************
  * Depending on the passed-in programID, either encrypts or decrypts
  * the passed-in message using the passed-in keyInput
- * Returns the transformed message
+ * Returns the transformed message, allocated for the caller to free
+ * (libotp's otpTransform writes into a caller-provided buffer instead)
 *******************************************************************************/
 char *transformMessage(char *keyInput, char *messageInput, char programID)
 {
-    int i = -5;
-    int keyVal = -5, msgVal = -5, newVal = -5;
-    int length = (int)strlen(messageInput);
-    int mod = NUM_CHAR_CHOICES;
-
-    char messageBuffer[BUFFER_SIZE];
-    memset(messageBuffer, '\0', sizeof(messageBuffer));
-
-    for (i = 0; i < length; i++) {
-
-        // Convert message character
-        if (messageInput[i] == ' ') { msgVal = mod-1; }    // If space, change to last valid element in keyChars
-        else { msgVal = (int)messageInput[i]-'A'; }
-
-        // Convert key character
-        if (keyInput[i] == ' ') { keyVal = mod-1; }        // If space, change to last valid element in keyChars
-        else { keyVal = (int)keyInput[i]-'A'; }
-
-        switch (programID) {
-            case 'E':                                                       // If encrypting
-                newVal = ((msgVal + keyVal) % mod) + 'A';
-                if (newVal == 91) { newVal = ' '; }                         // If > 'Z', change to space
-                break;
+    size_t length = strlen(messageInput);
 
-            case 'D':                                                       // If decrypting (Resource: https://stackoverflow.com/questions/11720656/modulo-operation-with-negative-numbers)
-                newVal = msgVal - keyVal;
-                newVal = ((newVal % mod + mod) % mod) + 'A';
-                if (newVal == 91) { newVal = ' '; }                         // If > 'Z', change to space
-                break;
+    char* returnMessage = calloc(length+1, sizeof(char));
+    if (!returnMessage) { return NULL; }
 
-            default:
-                fprintf(stderr, "Error: Not a valid programID\n"); exit(3);
-                break;
-        }
-
-        messageBuffer[i] = (char)newVal;
+    int status = otpTransform(programID, keyInput, strlen(keyInput), messageInput, length, returnMessage, length+1);
+    if (status != OTP_OK) {
+        fprintf(stderr, "Error: %s\n", otpStatusString(status)); exit(3);
     }
 
-    // Return a char* (Resource: https://stackoverflow.com/questions/46013382/c-strndup-implicit-declaration)
-    char* returnMessage = calloc((size_t)length+1, sizeof(char));
-    if (returnMessage) {
-        memcpy(returnMessage, messageBuffer, length+1);
-    }
     return returnMessage;
 }
+
+/*******************************************************************************
+ * Return the current CLOCK_MONOTONIC time in nanoseconds
+*******************************************************************************/
+unsigned long long monotonicNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
@@ -12,23 +12,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include "libotp.h"
 
 #define bool int
 #define true 1
 #define false 0
 
-#define NUM_CHAR_CHOICES 27
+#define NUM_CHAR_CHOICES OTP_NUM_SYMBOLS
 #define NUM_CONNECTIONS 5
 #define BUFFER_SIZE 1048576     //2^20
 #define CHUNK_SIZE 512
-#define TERMINATOR "@@"
+#define TERMINATOR OTP_TERMINATOR
 
 extern const char keyChars[NUM_CHAR_CHOICES];
-char programID;
+extern char programID;
 
 void error(const char* msg);
 bool checkChars(char* input);
 char* readFile(char* fileName);
 char* transformMessage(char *keyInput, char *messageInput, char programID);
+unsigned long long monotonicNanos();
 
 #endif //OTP_OTP_H
@@ -0,0 +1,396 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the key reuse index kept by the otp daemons
+ * Windows start where the key itself says: at two spaces in a row whose
+ * next 8 symbols hash with their top ANCHOR_BITS bits 0, about one in
+ * 2900 symbols of a random key, so the same key symbols start the same
+ * windows wherever a request begins
+ * A window's key entry hashes its first KEY_FINGERPRINT symbols, which
+ * for a random key is as good as hashing all of it; its pair entry hashes
+ * all of the message under the window, up to where the next one starts
+ * With AVX2, one pass over key and message finds the anchors and hashes
+ * the message: each 32-symbol step compares the key symbols with spaces
+ * and multiplies the halves of each message+key word (NH, keyed by the
+ * pad itself), adding the products up per window; elsewhere anchors are
+ * found with memchr and each window's message hashed after
+ * The filter is blocked: both of a window's entries, the key alone and
+ * the key with its message, set bits in one 64-byte line chosen by the
+ * key, so indexing a window costs at most one cache miss per generation,
+ * and that line is prefetched as the window starts, to arrive while the
+ * window is hashed
+ * Bits are set with plain relaxed stores, so workers need no lock and no
+ * locked instruction; an entry racing with another worker on the same
+ * word may be lost, as may one racing with the worker whose windows fill
+ * a generation clearing the older one, which then becomes current
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "otp_keyindex.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BLOCK_WORDS 8                   // 64-bit words in one 64-byte block
+#define BITS_PER_ENTRY 4
+#define GENERATION_BYTES (KEY_INDEX_BYTES / 2)
+#define NUM_BLOCKS (GENERATION_BYTES / (BLOCK_WORDS * sizeof(uint64_t)))
+#define HEADER_BYTES 4096               // Shared counters, a page ahead of the filters
+#define ANCHOR_SYMBOL ' '               // Two in a row: about 1 in 729 symbols of a random key
+#define ANCHOR_BITS 2                   // With them, a window starts every ~2^2 * 729 symbols
+#define STEP_SYMBOLS 32                 // Key and message symbols per AVX2 step
+
+struct keyIndexHeader {
+    uint64_t windowsIndexed;            // In the current generation
+    uint64_t generation;                // Even: first filter is current
+};
+
+// One call's view of the filter, and the window it is hashing
+struct keyIndexer {
+    uint64_t* current;                  // Blocks of the generation entries are set in
+    uint64_t* older;                    // Blocks of the one they are only looked up in
+    uint64_t seed;
+    uint64_t keyHash;
+    size_t reused;
+    size_t windows;
+};
+
+int keyReusePolicy = KEY_REUSE_FLAG;
+
+static struct keyIndexHeader* header = NULL;
+static uint64_t* filters = NULL;        // Both generations, back to back
+static bool haveAVX2 = false;
+
+/*******************************************************************************
+ * Set the policy from its name on the command line
+ * Returns whether the name was one of off, flag or reject
+*******************************************************************************/
+bool setKeyReusePolicy(const char* name)
+{
+    if (strcmp(name, "off") == 0) { keyReusePolicy = KEY_REUSE_OFF; }
+    else if (strcmp(name, "flag") == 0) { keyReusePolicy = KEY_REUSE_FLAG; }
+    else if (strcmp(name, "reject") == 0) { keyReusePolicy = KEY_REUSE_REJECT; }
+    else { return false; }
+    return true;
+}
+
+/*******************************************************************************
+ * Map the filter as shared anonymous memory before any worker is forked
+ * Pages are only faulted in as windows land in them
+*******************************************************************************/
+void initKeyIndex()
+{
+    if (keyReusePolicy == KEY_REUSE_OFF) { return; }
+
+    char* mapping = mmap(NULL, HEADER_BYTES + KEY_INDEX_BYTES, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) { error("keyindex: ERROR mapping shared memory"); }
+    header = (struct keyIndexHeader*)mapping;
+    filters = (uint64_t*)(mapping + HEADER_BYTES);
+
+    // Workers are forked from here, so all of them hash the same way
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    haveAVX2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+/*******************************************************************************
+ * Mix passed-in value into a well-distributed 64-bit hash
+*******************************************************************************/
+static uint64_t mixHash(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+/*******************************************************************************
+ * Returns the hash of KEY_FINGERPRINT symbols at passed-in text, seeded
+*******************************************************************************/
+static uint64_t fingerprint(const char* text, uint64_t seed)
+{
+    uint64_t low, high;
+
+    memcpy(&low, text, sizeof(low));
+    memcpy(&high, text + sizeof(low), sizeof(high));
+    return mixHash(seed ^ low ^ mixHash(high));
+}
+
+/*******************************************************************************
+ * Returns the hash of length message symbols at passed-in text, seeded
+*******************************************************************************/
+static uint64_t hashSpan(const char* text, size_t length, uint64_t seed)
+{
+    uint64_t hash = seed ^ length;
+    uint64_t word;
+    size_t i = 0;
+
+    for (; i + sizeof(word) <= length; i += sizeof(word)) {
+        memcpy(&word, text + i, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    word = 0;
+    memcpy(&word, text + i, length - i);
+    return mixHash(hash ^ word);
+}
+
+/*******************************************************************************
+ * Returns whether the two spaces at passed-in key symbols start a window
+*******************************************************************************/
+static bool isAnchor(const char* spaces)
+{
+    uint64_t symbols;
+
+    memcpy(&symbols, spaces + 2, sizeof(symbols));
+    return (symbols * 0x9e3779b97f4a7c15ULL) >> (64 - ANCHOR_BITS) == 0;
+}
+
+/*******************************************************************************
+ * Returns the first anchor at or after from and no later than last, or
+ * NULL if there is none; the key must hold 16 symbols from last on
+*******************************************************************************/
+static const char* findAnchor(const char* from, const char* last)
+{
+    for (; from <= last; from++) {
+        from = memchr(from, ANCHOR_SYMBOL, (size_t)(last - from) + 1);
+        if (!from) { return NULL; }
+        if (from[1] == ANCHOR_SYMBOL && isAnchor(from)) { return from; }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+ * Add an entry's BITS_PER_ENTRY bits to the block's words in bits, 9 hash
+ * bits choosing each
+*******************************************************************************/
+static void entryBits(uint64_t bits[BLOCK_WORDS], uint64_t hash)
+{
+    for (int i = 0; i < BITS_PER_ENTRY; i++, hash >>= 9) {
+        bits[(hash >> 6) & (BLOCK_WORDS - 1)] |= 1ULL << (hash & 63);
+    }
+}
+
+static size_t blockOf(uint64_t keyHash)
+{
+    return (keyHash >> 40) % NUM_BLOCKS * BLOCK_WORDS;
+}
+
+/*******************************************************************************
+ * Start a window at passed-in key symbols: fingerprint them, and fetch the
+ * window's blocks while its message is hashed
+*******************************************************************************/
+static void startWindow(struct keyIndexer* indexer, const char* key)
+{
+    indexer->keyHash = fingerprint(key, indexer->seed);
+    __builtin_prefetch(&indexer->current[blockOf(indexer->keyHash)], 1);
+    __builtin_prefetch(&indexer->older[blockOf(indexer->keyHash)], 0);
+}
+
+/*******************************************************************************
+ * Index the window started last, with the hash of the message under it,
+ * in the current generation's block, looking in the older one's too
+ * Counts it as reused if the key window was seen before with another message
+*******************************************************************************/
+static void endWindow(struct keyIndexer* indexer, uint64_t pairHash)
+{
+    uint64_t* current = &indexer->current[blockOf(indexer->keyHash)];
+    uint64_t* older = &indexer->older[blockOf(indexer->keyHash)];
+    uint64_t keyBits[BLOCK_WORDS] = {0}, pairBits[BLOCK_WORDS] = {0};
+    uint64_t keyMissing = 0, pairMissing = 0, keyMissingOlder = 0, pairMissingOlder = 0;
+
+    entryBits(keyBits, indexer->keyHash);
+    entryBits(pairBits, pairHash);
+
+    // Both entries are always set in the current generation
+    for (int i = 0; i < BLOCK_WORDS; i++) {
+        uint64_t word = __atomic_load_n(&current[i], __ATOMIC_RELAXED);
+        uint64_t olderWord = __atomic_load_n(&older[i], __ATOMIC_RELAXED);
+
+        keyMissing |= keyBits[i] & ~word;
+        pairMissing |= pairBits[i] & ~word;
+        keyMissingOlder |= keyBits[i] & ~olderWord;
+        pairMissingOlder |= pairBits[i] & ~olderWord;
+        if ((keyBits[i] | pairBits[i]) & ~word) {
+            __atomic_store_n(&current[i], word | keyBits[i] | pairBits[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    bool keySeen = !keyMissing || !keyMissingOlder;
+    bool pairSeen = !pairMissing || !pairMissingOlder;
+    indexer->reused += keySeen && !pairSeen;
+    indexer->windows++;
+}
+
+/*******************************************************************************
+ * Index length symbols of key and message a window at a time, finding
+ * each window's end with memchr and then hashing its message
+*******************************************************************************/
+static void indexWindows(struct keyIndexer* indexer, const char* key, const char* message, size_t length)
+{
+    const char* last = key + length - KEY_FINGERPRINT;
+    const char* anchor = key;
+    size_t start = 0;
+
+    while (anchor) {
+        startWindow(indexer, key + start);
+
+        // A window ends where the next starts
+        anchor = findAnchor(key + start + 1, last);
+        size_t end = anchor ? (size_t)(anchor - key) : length;
+        endWindow(indexer, hashSpan(message + start, end - start, indexer->keyHash));
+        start = end;
+    }
+}
+
+#if defined(__x86_64__)
+/*******************************************************************************
+ * Add the NH products of one step of message and key symbols to sums:
+ * each 32-bit half of message+key times the other half
+*******************************************************************************/
+__attribute__((target("avx2")))
+static __m256i addStep(__m256i sums, __m256i messageSymbols, __m256i keySymbols)
+{
+    __m256i words = _mm256_add_epi32(messageSymbols, keySymbols);
+    return _mm256_add_epi64(sums, _mm256_mul_epu32(words, _mm256_srli_epi64(words, 32)));
+}
+
+/*******************************************************************************
+ * addStep for the last length (under STEP_SYMBOLS) symbols of a window,
+ * padded with zeros
+*******************************************************************************/
+__attribute__((target("avx2")))
+static __m256i addPartialStep(__m256i sums, const char* key, const char* message, size_t length)
+{
+    char keyStep[STEP_SYMBOLS] = {0}, messageStep[STEP_SYMBOLS] = {0};
+
+    memcpy(keyStep, key, length);
+    memcpy(messageStep, message, length);
+    return addStep(sums, _mm256_loadu_si256((const __m256i*)messageStep), _mm256_loadu_si256((const __m256i*)keyStep));
+}
+
+/*******************************************************************************
+ * End the window started last, of length symbols, hashing its NH sums
+ * Takes them stored, so the vector registers can be cleared first: SSE
+ * code, as this is, runs slowly while their upper halves hold anything
+*******************************************************************************/
+static void endWindowSums(struct keyIndexer* indexer, const uint64_t sums[4], size_t length)
+{
+    endWindow(indexer, mixHash(indexer->keyHash ^ length ^
+                               mixHash(sums[0] ^ mixHash(sums[1] ^ mixHash(sums[2] ^ mixHash(sums[3]))))));
+}
+
+/*******************************************************************************
+ * indexWindows in one AVX2 pass: each step looks for anchors among its key
+ * symbols and adds its message to the window's sums; steps start at the
+ * window's start, so a window hashes the same wherever a request begins
+*******************************************************************************/
+__attribute__((target("avx2")))
+static void indexWindowsAVX2(struct keyIndexer* indexer, const char* key, const char* message, size_t length)
+{
+    const __m256i spaces = _mm256_set1_epi8(ANCHOR_SYMBOL);
+    const char* last = key + length - KEY_FINGERPRINT;
+    __m256i sums = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    size_t start = 0, i = 0;
+
+    startWindow(indexer, key);
+
+    // Each step also reads the key symbol after it, to see pairs that straddle steps
+    while (i + STEP_SYMBOLS < length) {
+        __m256i keySymbols = _mm256_loadu_si256((const __m256i*)(key + i));
+        __m256i nextSymbols = _mm256_loadu_si256((const __m256i*)(key + i + 1));
+        unsigned int pairs = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(keySymbols, spaces), _mm256_cmpeq_epi8(nextSymbols, spaces)));
+
+        if (i == start) { pairs &= ~1u; }                       // The window's own anchor
+        for (; pairs; pairs &= pairs - 1) {
+            const char* candidate = key + i + __builtin_ctz(pairs);
+            if (candidate <= last && isAnchor(candidate)) { break; }
+        }
+
+        if (!pairs) {
+            sums = addStep(sums, _mm256_loadu_si256((const __m256i*)(message + i)), keySymbols);
+            i += STEP_SYMBOLS;
+            continue;
+        }
+
+        // A window ends where the next starts
+        size_t end = i + __builtin_ctz(pairs);
+        sums = addPartialStep(sums, key + i, message + i, end - i);
+        _mm256_storeu_si256((__m256i*)lanes, sums);
+        _mm256_zeroupper();
+        endWindowSums(indexer, lanes, end - start);
+        start = i = end;
+        sums = _mm256_setzero_si256();
+        startWindow(indexer, key + start);
+    }
+
+    // At most one step is left, and any anchors in it are found one by one
+    while (1) {
+        const char* anchor = findAnchor(key + (i > start ? i : start + 1), last);
+        size_t end = anchor ? (size_t)(anchor - key) : length;
+
+        sums = addPartialStep(sums, key + i, message + i, end - i);
+        _mm256_storeu_si256((__m256i*)lanes, sums);
+        _mm256_zeroupper();
+        endWindowSums(indexer, lanes, end - start);
+        if (!anchor) { break; }
+
+        start = i = end;
+        sums = _mm256_setzero_si256();
+        startWindow(indexer, key + start);
+    }
+}
+#endif
+
+/*******************************************************************************
+ * Count passed-in windows in the current generation; the call whose
+ * windows fill it clears the older generation and makes that current
+*******************************************************************************/
+static void countWindows(uint64_t count)
+{
+    uint64_t windows = __atomic_add_fetch(&header->windowsIndexed, count, __ATOMIC_RELAXED);
+    if (windows < KEY_GENERATION_WINDOWS || windows - count >= KEY_GENERATION_WINDOWS) { return; }
+
+    uint64_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    memset(&filters[((generation + 1) & 1) * NUM_BLOCKS * BLOCK_WORDS], 0, GENERATION_BYTES);
+    __atomic_store_n(&header->windowsIndexed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->generation, generation + 1, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * Index the windows of the passed-in key that cover the first length
+ * symbols, with the message transformed under it: one at the start, and
+ * one at each anchor the key holds
+ * Windows shorter than KEY_FINGERPRINT are too guessable to index
+ * Returns the number of windows already used with another message
+*******************************************************************************/
+size_t indexKeyWindows(char mode, const char* key, const char* message, size_t length)
+{
+    struct keyIndexer indexer = {0};
+
+    if (!filters || length < KEY_FINGERPRINT) { return 0; }
+
+    // Encrypting then decrypting with one key is normal, so each mode has its own entries
+    uint64_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    indexer.current = &filters[(generation & 1) * NUM_BLOCKS * BLOCK_WORDS];
+    indexer.older = &filters[((generation + 1) & 1) * NUM_BLOCKS * BLOCK_WORDS];
+    indexer.seed = mixHash((uint64_t)(unsigned char)mode);
+
+    // Anchors depend on the key alone, so are the same in both modes
+#if defined(__x86_64__)
+    if (haveAVX2) { indexWindowsAVX2(&indexer, key, message, length); }
+    else { indexWindows(&indexer, key, message, length); }
+#else
+    indexWindows(&indexer, key, message, length);
+#endif
+
+    countWindows(indexer.windows);
+    return indexer.reused;
+}
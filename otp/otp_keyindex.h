@@ -0,0 +1,38 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the key reuse index kept by the otp daemons:
+ *   each key used is cut into windows at anchors picked by the key's own
+ *   content, so the same key symbols give the same windows however far
+ *   into a request they fall, and a window also starts each request
+ *   fingerprints go into a Bloom filter in shared memory, so every
+ *   forked worker sees keys used on every other connection
+ *   a key window seen before with a different message under it is reuse;
+ *   the same key and message again (a retransmit or retry) is not
+ *   the filter has two generations; once the current one holds
+ *   KEY_GENERATION_WINDOWS windows the older is cleared and reused, so
+ *   it never fills up, and reuse is caught within the last 1-2 generations
+*******************************************************************************/
+
+#ifndef OTP_KEYINDEX_H
+#define OTP_KEYINDEX_H
+
+#include <stddef.h>
+#include "otp_helpers.h"
+
+#define KEY_FINGERPRINT 16              // Key symbols hashed per window, about 76 bits
+#define KEY_INDEX_BYTES (16u << 20)     // Both generations together
+#define KEY_GENERATION_WINDOWS (3u << 20)   // Windows per generation, for ~1% false positives
+
+enum keyReusePolicy {
+    KEY_REUSE_OFF,
+    KEY_REUSE_FLAG,                     // Count reuse in the metrics only
+    KEY_REUSE_REJECT                    // Also refuse the request
+};
+
+extern int keyReusePolicy;
+
+void initKeyIndex();
+bool setKeyReusePolicy(const char* name);
+size_t indexKeyWindows(char mode, const char* key, const char* message, size_t length);
+
+#endif //OTP_KEYINDEX_H
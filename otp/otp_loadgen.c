@@ -0,0 +1,185 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for otp_loadgen, a mixed-workload load generator
+ *   small clients send short requests back to back and time each one
+ *   bulk clients keep large transforms running to load the daemon
+ *   reports throughput and p50/p99/p99.9 latency for each class
+ * Every client holds one persistent libotp connection
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "otp_helpers.h"
+
+struct loadClient {
+    pthread_t thread;
+    int port;
+    char mode;
+    size_t requestBytes;
+    unsigned long long deadline;
+    unsigned int seed;
+    unsigned long long* latencies;      // Nanoseconds per completed request
+    size_t numLatencies;
+    size_t capacity;
+    int failures;
+};
+
+/******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void usage(char *program)
+{
+    fprintf(stderr, "USAGE: %s [-m E|D] [-s smallClients] [-S smallBytes] "
+                    "[-b bulkClients] [-B bulkBytes] [-d seconds] port\n", program);
+    exit(1);
+}
+
+/******************************************************************************
+ * Fill passed-in buffer with length random symbols
+*******************************************************************************/
+static void randomSymbols(char *buffer, size_t length, unsigned int *seed)
+{
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = keyChars[rand_r(seed) % NUM_CHAR_CHOICES];
+    }
+}
+
+/******************************************************************************
+ * Client thread: send requests of its size until the deadline
+*******************************************************************************/
+static void* runLoadClient(void *argument)
+{
+    struct loadClient *client = argument;
+    struct otpConnection *connection = NULL;
+
+    char *key = malloc(client->requestBytes);
+    char *message = malloc(client->requestBytes);
+    char *output = malloc(client->requestBytes + 1);
+    if (!key || !message || !output) { error("malloc"); }
+    randomSymbols(key, client->requestBytes, &client->seed);
+    randomSymbols(message, client->requestBytes, &client->seed);
+
+    int status = otpConnect("localhost", client->port, client->mode, &connection);
+    if (status != OTP_OK) {
+        fprintf(stderr, "otp_loadgen: ERROR connecting: %s\n", otpStatusString(status));
+        exit(1);
+    }
+
+    while (monotonicNanos() < client->deadline) {
+        unsigned long long start = monotonicNanos();
+        status = otpRemoteTransform(connection, key, client->requestBytes, message, client->requestBytes,
+                                    output, client->requestBytes + 1);
+        if (status != OTP_OK) { client->failures++; break; }
+
+        if (client->numLatencies == client->capacity) {
+            client->capacity = client->capacity ? client->capacity * 2 : 1024;
+            client->latencies = realloc(client->latencies, client->capacity * sizeof(unsigned long long));
+            if (!client->latencies) { error("realloc"); }
+        }
+        client->latencies[client->numLatencies++] = monotonicNanos() - start;
+    }
+
+    otpClose(connection);
+    free(key);
+    free(message);
+    free(output);
+    return NULL;
+}
+
+/******************************************************************************
+ * qsort comparison for latencies
+*******************************************************************************/
+static int compareLatencies(const void *a, const void *b)
+{
+    unsigned long long first = *(const unsigned long long*)a;
+    unsigned long long second = *(const unsigned long long*)b;
+    return (first > second) - (first < second);
+}
+
+/******************************************************************************
+ * Merge the latencies of passed-in clients and print one summary line
+*******************************************************************************/
+static void reportClass(const char *className, struct loadClient *clients, int numClients, double seconds)
+{
+    size_t total = 0;
+    int failures = 0;
+
+    for (int i = 0; i < numClients; i++) {
+        total += clients[i].numLatencies;
+        failures += clients[i].failures;
+    }
+    if (numClients == 0) { return; }
+    if (total == 0) {
+        printf("%-5s requests 0 failures %d\n", className, failures);
+        return;
+    }
+
+    unsigned long long *merged = malloc(total * sizeof(unsigned long long));
+    if (!merged) { error("malloc"); }
+    size_t position = 0;
+    for (int i = 0; i < numClients; i++) {
+        memcpy(merged + position, clients[i].latencies, clients[i].numLatencies * sizeof(unsigned long long));
+        position += clients[i].numLatencies;
+    }
+    qsort(merged, total, sizeof(unsigned long long), compareLatencies);
+
+    printf("%-5s requests %zu rate %.1f/s p50 %lluus p99 %lluus p99.9 %lluus max %lluus failures %d\n",
+           className, total, (double)total / seconds,
+           merged[total / 2] / 1000, merged[total * 99 / 100] / 1000,
+           merged[total * 999 / 1000] / 1000, merged[total - 1] / 1000, failures);
+    free(merged);
+}
+
+int main(int argc, char *argv[])
+{
+    int option = -5;
+    char mode = OTP_ENCRYPT;
+    int numSmall = 4, numBulk = 8;
+    size_t smallBytes = 100, bulkBytes = 524288;
+    double seconds = 5.0;
+
+    while ((option = getopt(argc, argv, "m:s:S:b:B:d:")) != -1) {
+        switch (option) {
+            case 'm': mode = optarg[0]; break;
+            case 's': numSmall = atoi(optarg); break;
+            case 'S': smallBytes = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'b': numBulk = atoi(optarg); break;
+            case 'B': bulkBytes = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'd': seconds = atof(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || (mode != OTP_ENCRYPT && mode != OTP_DECRYPT) ||
+        numSmall < 0 || numBulk < 0 || smallBytes == 0 || bulkBytes == 0 || seconds <= 0) {
+        usage(argv[0]);
+    }
+    int port = atoi(argv[optind]);
+
+    struct loadClient *clients = calloc((size_t)(numSmall + numBulk), sizeof(struct loadClient));
+    if (!clients) { error("calloc"); }
+
+    // Small clients first, so each class is a contiguous run
+    unsigned long long deadline = monotonicNanos() + (unsigned long long)(seconds * 1e9);
+    for (int i = 0; i < numSmall + numBulk; i++) {
+        clients[i].port = port;
+        clients[i].mode = mode;
+        clients[i].requestBytes = i < numSmall ? smallBytes : bulkBytes;
+        clients[i].deadline = deadline;
+        clients[i].seed = (unsigned int)(i + 1);
+        if (pthread_create(&clients[i].thread, NULL, runLoadClient, &clients[i]) != 0) { error("pthread_create"); }
+    }
+    for (int i = 0; i < numSmall + numBulk; i++) {
+        pthread_join(clients[i].thread, NULL);
+    }
+
+    reportClass("small", clients, numSmall, seconds);
+    reportClass("bulk", clients + numSmall, numBulk, seconds);
+
+    for (int i = 0; i < numSmall + numBulk; i++) { free(clients[i].latencies); }
+    free(clients);
+    return 0;
+}
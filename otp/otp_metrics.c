@@ -0,0 +1,195 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the live metrics kept by the otp daemons:
+ *   lock-free counters and latency histograms in shared memory
+ *   aggregation of all worker slots into daemon totals
+ *   SIGUSR1 dump request and local (AF_UNIX) stats socket
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+#include "otp_metrics.h"
+
+struct daemonMetrics* metrics = NULL;
+volatile sig_atomic_t metricsDumpRequested = false;
+
+static __thread struct workerMetrics* mySlot = NULL;    // Per thread in the threaded daemon
+
+static const char* counterNames[NUM_METRIC_COUNTERS] = {
+    "connections_accepted", "connections_rejected", "handshake_failures",
+    "bytes_in", "bytes_out", "transforms", "encrypts", "decrypts", "transform_ns",
+    "checksum_failures", "throttled_requests", "throttle_ns", "queued_requests", "fast_lane_requests",
+    "buffer_slot_fallbacks", "key_reuse_requests"
+};
+static const char* histogramNames[NUM_METRIC_HISTOGRAMS] = {
+    "transform_us", "request_us", "queue_us"
+};
+
+/*******************************************************************************
+ * Map the metrics block as shared anonymous memory before any worker is forked
+ * so every child process writes into the same pages as the parent
+*******************************************************************************/
+void initMetrics()
+{
+    metrics = mmap(NULL, sizeof(struct daemonMetrics), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (metrics == MAP_FAILED) { error("metrics: ERROR mapping shared memory"); }
+
+    memset(metrics, 0, sizeof(struct daemonMetrics));
+    metrics->startNanos = monotonicNanos();
+    claimMetricsSlot(0);
+}
+
+/*******************************************************************************
+ * Select the slot the calling worker process or thread updates
+ * Workers that hash to the same slot stay correct since all updates are atomic
+*******************************************************************************/
+void claimMetricsSlot(int workerID)
+{
+    if (!metrics) { return; }
+    mySlot = &metrics->slots[(unsigned)workerID % METRICS_WORKER_SLOTS];
+}
+
+/*******************************************************************************
+ * Add passed-in amount to a counter in the calling worker's slot
+*******************************************************************************/
+void countMetric(enum metricCounter counter, unsigned long long amount)
+{
+    if (!mySlot) { return; }
+    __atomic_fetch_add(&mySlot->counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ * Record passed-in latency in its log2 microsecond bucket
+*******************************************************************************/
+void recordLatency(enum metricHistogram histogram, unsigned long long nanos)
+{
+    if (!mySlot) { return; }
+
+    unsigned long long micros = nanos / 1000;
+    int bucket = micros ? 64 - __builtin_clzll(micros) : 0;
+    if (bucket >= METRICS_HIST_BUCKETS) { bucket = METRICS_HIST_BUCKETS - 1; }
+
+    __atomic_fetch_add(&mySlot->histograms[histogram][bucket], 1, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ * Sum every worker slot and write the totals to passed-in stream
+ * One "name value" pair per line; histogram buckets are labelled by upper bound
+*******************************************************************************/
+void writeMetrics(FILE* out, const char* daemonName)
+{
+    unsigned long long totals[NUM_METRIC_COUNTERS] = {0};
+    unsigned long long buckets[NUM_METRIC_HISTOGRAMS][METRICS_HIST_BUCKETS] = {{0}};
+
+    if (!metrics) { return; }
+
+    for (int s = 0; s < METRICS_WORKER_SLOTS; s++) {
+        for (int c = 0; c < NUM_METRIC_COUNTERS; c++) {
+            totals[c] += __atomic_load_n(&metrics->slots[s].counters[c], __ATOMIC_RELAXED);
+        }
+        for (int h = 0; h < NUM_METRIC_HISTOGRAMS; h++) {
+            for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                buckets[h][b] += __atomic_load_n(&metrics->slots[s].histograms[h][b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    fprintf(out, "# %s metrics\n", daemonName);
+    fprintf(out, "uptime_ms %llu\n", (monotonicNanos() - metrics->startNanos) / 1000000);
+    for (int c = 0; c < NUM_METRIC_COUNTERS; c++) {
+        fprintf(out, "%s %llu\n", counterNames[c], totals[c]);
+    }
+
+    // Print only non-empty buckets to keep the dump compact
+    for (int h = 0; h < NUM_METRIC_HISTOGRAMS; h++) {
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            if (buckets[h][b]) {
+                fprintf(out, "%s_lt_%lluus %llu\n", histogramNames[h], 1ULL << b, buckets[h][b]);
+            }
+        }
+    }
+    fflush(out);
+}
+
+/*******************************************************************************
+ * Signal handler only flags the request; the accept loop does the dump
+*******************************************************************************/
+static void catchSIGUSR1(int signalNum)
+{
+    metricsDumpRequested = true;
+}
+
+/*******************************************************************************
+ * Install the SIGUSR1 handler without SA_RESTART so a blocked accept() returns
+*******************************************************************************/
+void installMetricsDumpHandler()
+{
+    struct sigaction SIGUSR1_action = {{0}};
+    SIGUSR1_action.sa_handler = catchSIGUSR1;
+    sigfillset(&SIGUSR1_action.sa_mask);
+    SIGUSR1_action.sa_flags = 0;
+    sigaction(SIGUSR1, &SIGUSR1_action, NULL);
+}
+
+/*******************************************************************************
+ * Fork a small stats process listening on passed-in AF_UNIX socket path
+ * Each connection receives one metrics dump and is closed
+ * The stats process exits when the daemon does
+*******************************************************************************/
+void startStatsServer(const char* socketPath, const char* daemonName)
+{
+    struct sockaddr_un statsAddress;
+
+    if (strlen(socketPath) >= sizeof(statsAddress.sun_path)) {
+        fprintf(stderr, "%s: stats socket path too long\n", daemonName);
+        exit(1);
+    }
+
+    pid_t statsPID = fork();
+    switch (statsPID) {
+        case -1:
+            perror("fork"); exit(1);
+            break;
+
+        case 0:
+            prctl(PR_SET_PDEATHSIG, SIGTERM);                       // Exit together with the daemon
+            signal(SIGUSR1, SIG_IGN);
+
+            memset(&statsAddress, '\0', sizeof(statsAddress));
+            statsAddress.sun_family = AF_UNIX;
+            strcpy(statsAddress.sun_path, socketPath);
+            unlink(socketPath);                                     // Remove stale socket from previous run
+
+            int statsSocketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (statsSocketFD < 0) { error("stats: ERROR opening socket"); }
+            if (bind(statsSocketFD, (struct sockaddr*)&statsAddress, sizeof(statsAddress)) < 0) {
+                error("stats: ERROR on binding");
+            }
+            listen(statsSocketFD, NUM_CONNECTIONS);
+
+            while (1) {
+                int connectionFD = accept(statsSocketFD, NULL, NULL);
+                if (connectionFD < 0) { continue; }
+
+                FILE* out = fdopen(connectionFD, "w");
+                if (out) {
+                    writeMetrics(out, daemonName);
+                    fclose(out);                                    // Also closes connectionFD
+                }
+                else {
+                    close(connectionFD);
+                }
+            }
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the live metrics kept by the otp daemons:
+ *   per-worker counters and log2-bucket latency histograms
+ *   stored in shared memory so forked workers aggregate into one view
+ *   totals are dumped on SIGUSR1 or read over a local stats socket
+*******************************************************************************/
+
+#ifndef OTP_METRICS_H
+#define OTP_METRICS_H
+
+#include <stdio.h>
+#include <signal.h>
+#include "otp_helpers.h"
+
+#define METRICS_WORKER_SLOTS 64
+#define METRICS_HIST_BUCKETS 40         // Bucket i counts latencies < 2^i microseconds
+
+enum metricCounter {
+    MC_CONN_ACCEPTED,
+    MC_CONN_REJECTED,
+    MC_HANDSHAKE_FAILURES,
+    MC_BYTES_IN,
+    MC_BYTES_OUT,
+    MC_TRANSFORMS,
+    MC_ENCRYPTS,
+    MC_DECRYPTS,
+    MC_TRANSFORM_NS,
+    MC_CHECKSUM_FAILURES,
+    MC_THROTTLED,
+    MC_THROTTLE_NS,
+    MC_QUEUED,
+    MC_FAST_LANE,
+    MC_BUFFER_FALLBACKS,
+    MC_KEY_REUSE,
+    NUM_METRIC_COUNTERS
+};
+
+enum metricHistogram {
+    MH_TRANSFORM_US,
+    MH_REQUEST_US,
+    MH_QUEUE_US,
+    NUM_METRIC_HISTOGRAMS
+};
+
+// One slot per worker, padded so workers never share a cache line
+struct workerMetrics {
+    unsigned long long counters[NUM_METRIC_COUNTERS];
+    unsigned long long histograms[NUM_METRIC_HISTOGRAMS][METRICS_HIST_BUCKETS];
+} __attribute__((aligned(64)));
+
+struct daemonMetrics {
+    unsigned long long startNanos;
+    struct workerMetrics slots[METRICS_WORKER_SLOTS];
+};
+
+extern struct daemonMetrics* metrics;
+extern volatile sig_atomic_t metricsDumpRequested;
+
+void initMetrics();
+void claimMetricsSlot(int workerID);
+void countMetric(enum metricCounter counter, unsigned long long amount);
+void recordLatency(enum metricHistogram histogram, unsigned long long nanos);
+void writeMetrics(FILE* out, const char* daemonName);
+void installMetricsDumpHandler();
+void startStatsServer(const char* socketPath, const char* daemonName);
+
+#endif //OTP_METRICS_H
@@ -0,0 +1,36 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the reference transform, as first written for
+ * transformMessage: map each symbol to 0-26, add or subtract modulo 27
+*******************************************************************************/
+
+#include "otp_reference.h"
+
+/*******************************************************************************
+ * Returns whether each of length characters of input exists in keyChars
+*******************************************************************************/
+bool referenceCheckChars(const char* input, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (input[i] != ' ' && (input[i] < 'A' || input[i] > 'Z')) { return false; }
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Encrypt ('E') or decrypt ('D') length valid symbols of input with key
+ * into output; output is not null-terminated
+*******************************************************************************/
+void referenceTransform(char mode, const char* key, const char* input, size_t length, char* output)
+{
+    int mod = NUM_CHAR_CHOICES;
+
+    for (size_t i = 0; i < length; i++) {
+        int msgVal = input[i] == ' ' ? mod - 1 : input[i] - 'A';    // Space is the last valid element
+        int keyVal = key[i] == ' ' ? mod - 1 : key[i] - 'A';
+
+        int newVal = mode == 'E' ? (msgVal + keyVal) % mod
+                                 : ((msgVal - keyVal) % mod + mod) % mod;
+        output[i] = newVal == mod - 1 ? ' ' : (char)(newVal + 'A');
+    }
+}
@@ -0,0 +1,17 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the reference transform: the original per-character
+ * modulo arithmetic, kept only so benchmarks and the fuzz harness can
+ * compare the table-driven kernels in libotp against it
+*******************************************************************************/
+
+#ifndef OTP_REFERENCE_H
+#define OTP_REFERENCE_H
+
+#include <stddef.h>
+#include "otp_helpers.h"
+
+bool referenceCheckChars(const char* input, size_t length);
+void referenceTransform(char mode, const char* key, const char* input, size_t length, char* output);
+
+#endif //OTP_REFERENCE_H
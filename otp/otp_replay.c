@@ -0,0 +1,331 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for otp_replay, which drives a daemon with a recorded trace
+ *   requests are sent at their recorded offsets from the first, divided
+ *   by -x (2 replays twice as fast; 0 sends each as soon as it can)
+ *   each traced connection is replayed on one libotp connection, opened
+ *   at its first request and closed after its last, in its own order
+ *   keys and messages come from the trace if it holds them, else are
+ *   random symbols of the recorded sizes, the same on every run
+ *   reports throughput, p50/p99/p99.9 latency and how late requests
+ *   started against the schedule, which shows when the daemon fell behind
+ * Connections are spread over -c client threads by trace order, so a
+ * given trace and thread count always produce the same request streams
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "otp_helpers.h"
+#include "otp_trace.h"
+
+#define REPLAY_LEAD_NANOS 100000000ULL  // Time to connect threads before the first request
+#define SYNTHETIC_SPREAD 65536          // Offsets synthetic keys and messages are cut at
+
+struct replayRequest {
+    struct traceRecord record;          // Copied out, as records in the trace are unaligned
+    const char* key;
+    const char* message;
+    size_t order;                       // Position in the trace, to keep sorting stable
+    int connection;                     // Dense index of record->connection
+};
+
+struct replayClient {
+    pthread_t thread;
+    int index;
+    unsigned long long* latencies;      // Nanoseconds per completed request
+    unsigned long long* lateness;       // Nanoseconds each started behind schedule
+    size_t numCompleted;
+    int failures;
+};
+
+static struct replayRequest* requests = NULL;
+static size_t numRequests = 0;
+static struct otpConnection** connections = NULL;      // One per traced connection
+static size_t* remainingRequests = NULL;               // Per traced connection
+static int numClients = 16;
+static int port = 0;
+static double speed = 1.0;
+static size_t maxMessageLength = 0;
+static unsigned long long replayStart = 0;
+
+/******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void usage(char *program)
+{
+    fprintf(stderr, "USAGE: %s [-x speed] [-c clients] trace port\n", program);
+    exit(1);
+}
+
+/******************************************************************************
+ * qsort comparisons: requests by arrival, then trace order; by connection;
+ * latencies
+*******************************************************************************/
+static int compareArrivals(const void *a, const void *b)
+{
+    const struct replayRequest *first = a, *second = b;
+    if (first->record.arrivalNanos != second->record.arrivalNanos) {
+        return first->record.arrivalNanos < second->record.arrivalNanos ? -1 : 1;
+    }
+    return (first->order > second->order) - (first->order < second->order);
+}
+
+static int compareConnections(const void *a, const void *b)
+{
+    const struct replayRequest *first = *(const struct replayRequest* const*)a;
+    const struct replayRequest *second = *(const struct replayRequest* const*)b;
+    if (first->record.connection != second->record.connection) {
+        return first->record.connection < second->record.connection ? -1 : 1;
+    }
+    return (first->order > second->order) - (first->order < second->order);
+}
+
+static int compareLatencies(const void *a, const void *b)
+{
+    unsigned long long first = *(const unsigned long long*)a;
+    unsigned long long second = *(const unsigned long long*)b;
+    return (first > second) - (first < second);
+}
+
+/******************************************************************************
+ * Read the whole trace at passed-in path and index its requests
+ * Requests without payloads get slices of one buffer of random symbols,
+ * cut at offsets that differ from request to request
+*******************************************************************************/
+static void loadTrace(const char *path)
+{
+    struct stat fileInfo;
+    size_t maxKeyLength = 0, capacity = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &fileInfo) < 0) { fprintf(stderr, "%s: %s\n", path, strerror(errno)); exit(1); }
+
+    size_t size = (size_t)fileInfo.st_size;
+    char* trace = malloc(size + 1);
+    if (!trace) { error("malloc"); }
+    for (size_t done = 0; done < size; ) {
+        ssize_t charsRead = read(fd, trace + done, size - done);
+        if (charsRead <= 0) { fprintf(stderr, "%s: short read\n", path); exit(1); }
+        done += (size_t)charsRead;
+    }
+    close(fd);
+
+    if (size < sizeof(struct traceHeader) || memcmp(trace, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "%s is not a request trace\n", path);
+        exit(1);
+    }
+
+    // Records are appended whole, but a daemon may have been killed mid-write
+    for (size_t offset = sizeof(struct traceHeader); offset + sizeof(struct traceRecord) <= size; ) {
+        struct traceRecord record;
+        memcpy(&record, trace + offset, sizeof(record));
+        size_t recordSize = sizeof(struct traceRecord) +
+            ((record.flags & TRACE_PAYLOADS) ? (size_t)record.keyLength + record.messageLength : 0);
+        if (offset + recordSize > size) { break; }
+
+        if (numRequests == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            requests = realloc(requests, capacity * sizeof(struct replayRequest));
+            if (!requests) { error("realloc"); }
+        }
+
+        struct replayRequest* request = &requests[numRequests];
+        request->record = record;
+        request->order = numRequests++;
+        request->key = (record.flags & TRACE_PAYLOADS) ? trace + offset + sizeof(struct traceRecord) : NULL;
+        request->message = request->key ? request->key + record.keyLength : NULL;
+
+        if (record.keyLength > maxKeyLength) { maxKeyLength = record.keyLength; }
+        if (record.messageLength > maxMessageLength) { maxMessageLength = record.messageLength; }
+        offset += recordSize;
+    }
+    if (numRequests == 0) { fprintf(stderr, "%s holds no requests\n", path); exit(1); }
+
+    // Random symbols for requests recorded without payloads
+    size_t spreadLength = (maxKeyLength > maxMessageLength ? maxKeyLength : maxMessageLength) + SYNTHETIC_SPREAD;
+    char* symbols = malloc(spreadLength);
+    if (!symbols) { error("malloc"); }
+    unsigned int seed = 1;
+    for (size_t i = 0; i < spreadLength; i++) { symbols[i] = keyChars[rand_r(&seed) % NUM_CHAR_CHOICES]; }
+
+    for (size_t i = 0; i < numRequests; i++) {
+        if (requests[i].key) { continue; }
+        requests[i].key = symbols + (i * 4099) % SYNTHETIC_SPREAD;
+        requests[i].message = symbols + (i * 7919 + SYNTHETIC_SPREAD / 2) % SYNTHETIC_SPREAD;
+    }
+
+    qsort(requests, numRequests, sizeof(struct replayRequest), compareArrivals);
+}
+
+/******************************************************************************
+ * Number the traced connections densely, in order of their ID
+ * Returns how many there are
+*******************************************************************************/
+static int numberConnections()
+{
+    struct replayRequest** byConnection = malloc(numRequests * sizeof(struct replayRequest*));
+    if (!byConnection) { error("malloc"); }
+    for (size_t i = 0; i < numRequests; i++) { byConnection[i] = &requests[i]; }
+    qsort(byConnection, numRequests, sizeof(struct replayRequest*), compareConnections);
+
+    int numConnections = 0;
+    for (size_t i = 0; i < numRequests; i++) {
+        if (i > 0 && byConnection[i]->record.connection != byConnection[i - 1]->record.connection) {
+            numConnections++;
+        }
+        byConnection[i]->connection = numConnections;
+    }
+    free(byConnection);
+    numConnections++;
+
+    connections = calloc((size_t)numConnections, sizeof(struct otpConnection*));
+    remainingRequests = calloc((size_t)numConnections, sizeof(size_t));
+    if (!connections || !remainingRequests) { error("calloc"); }
+    for (size_t i = 0; i < numRequests; i++) { remainingRequests[requests[i].connection]++; }
+
+    return numConnections;
+}
+
+/******************************************************************************
+ * Client thread: replay the requests of its connections on schedule
+ * A failed request closes its connection; the next one reconnects
+*******************************************************************************/
+static void* runReplayClient(void *argument)
+{
+    struct replayClient *client = argument;
+    unsigned long long firstArrival = requests[0].record.arrivalNanos;
+
+    char* output = malloc(maxMessageLength + 1);
+    client->latencies = malloc(numRequests * sizeof(unsigned long long));
+    client->lateness = malloc(numRequests * sizeof(unsigned long long));
+    if (!output || !client->latencies || !client->lateness) { error("malloc"); }
+
+    for (size_t i = 0; i < numRequests; i++) {
+        struct replayRequest* request = &requests[i];
+        const struct traceRecord* record = &request->record;
+        if (request->connection % numClients != client->index) { continue; }
+
+        // Wait for the request's turn, scaled by speed
+        unsigned long long due = replayStart;
+        if (speed > 0) { due += (unsigned long long)((double)(record->arrivalNanos - firstArrival) / speed); }
+        struct timespec dueTime = { (time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dueTime, NULL) == EINTR) {}
+
+        unsigned long long start = monotonicNanos();
+        struct otpConnection** connection = &connections[request->connection];
+        int status = OTP_OK;
+
+        if (!*connection) {
+            status = otpConnect("localhost", port, (char)record->mode, connection);
+            if (status == OTP_OK) { otpSetChecksums(*connection, record->flags & TRACE_CHECKED); }
+        }
+        if (status == OTP_OK) {
+            status = otpRemoteTransform(*connection, request->key, record->keyLength,
+                                        request->message, record->messageLength, output, maxMessageLength + 1);
+        }
+
+        if (status == OTP_OK) {
+            client->latencies[client->numCompleted] = monotonicNanos() - start;
+            client->lateness[client->numCompleted++] = start > due ? start - due : 0;
+        }
+        else {
+            client->failures++;
+            if (client->failures == 1) {
+                fprintf(stderr, "otp_replay: ERROR %s (further errors are only counted)\n", otpStatusString(status));
+            }
+        }
+
+        if (*connection && (status != OTP_OK || --remainingRequests[request->connection] == 0)) {
+            otpClose(*connection);
+            *connection = NULL;
+        }
+    }
+
+    free(output);
+    return NULL;
+}
+
+/******************************************************************************
+ * Merge passed-in per-client samples and return them sorted
+*******************************************************************************/
+static unsigned long long* mergeSamples(struct replayClient *clients, size_t total, bool lateness)
+{
+    unsigned long long *merged = malloc((total ? total : 1) * sizeof(unsigned long long));
+    if (!merged) { error("malloc"); }
+
+    size_t position = 0;
+    for (int i = 0; i < numClients; i++) {
+        memcpy(merged + position, lateness ? clients[i].lateness : clients[i].latencies,
+               clients[i].numCompleted * sizeof(unsigned long long));
+        position += clients[i].numCompleted;
+    }
+    qsort(merged, total, sizeof(unsigned long long), compareLatencies);
+    return merged;
+}
+
+int main(int argc, char *argv[])
+{
+    int option = -5;
+
+    while ((option = getopt(argc, argv, "x:c:")) != -1) {
+        switch (option) {
+            case 'x': speed = atof(optarg); break;
+            case 'c': numClients = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2 || speed < 0 || numClients <= 0 || atoi(argv[optind + 1]) < 0) { usage(argv[0]); }
+    port = atoi(argv[optind + 1]);
+
+    loadTrace(argv[optind]);
+    int numConnections = numberConnections();
+    double traceSeconds = (double)(requests[numRequests - 1].record.arrivalNanos - requests[0].record.arrivalNanos) / 1e9;
+
+    struct replayClient *clients = calloc((size_t)numClients, sizeof(struct replayClient));
+    if (!clients) { error("calloc"); }
+
+    replayStart = monotonicNanos() + REPLAY_LEAD_NANOS;
+    for (int i = 0; i < numClients; i++) {
+        clients[i].index = i;
+        if (pthread_create(&clients[i].thread, NULL, runReplayClient, &clients[i]) != 0) { error("pthread_create"); }
+    }
+
+    size_t total = 0;
+    int failures = 0;
+    for (int i = 0; i < numClients; i++) {
+        pthread_join(clients[i].thread, NULL);
+        total += clients[i].numCompleted;
+        failures += clients[i].failures;
+    }
+    double seconds = (double)(monotonicNanos() - replayStart) / 1e9;
+
+    printf("replayed %zu requests on %d connections in %.3fs (trace %.3fs, speed %gx)\n",
+           numRequests, numConnections, seconds, traceSeconds, speed);
+    if (total > 0) {
+        unsigned long long *latencies = mergeSamples(clients, total, false);
+        unsigned long long *lateness = mergeSamples(clients, total, true);
+        printf("rate %.1f/s p50 %lluus p99 %lluus p99.9 %lluus max %lluus late p50 %lluus p99 %lluus failures %d\n",
+               (double)total / seconds, latencies[total / 2] / 1000, latencies[total * 99 / 100] / 1000,
+               latencies[total * 999 / 1000] / 1000, latencies[total - 1] / 1000,
+               lateness[total / 2] / 1000, lateness[total * 99 / 100] / 1000, failures);
+        free(latencies);
+        free(lateness);
+    }
+    else {
+        printf("no request succeeded, failures %d\n", failures);
+    }
+
+    for (int i = 0; i < numClients; i++) {
+        free(clients[i].latencies);
+        free(clients[i].lateness);
+    }
+    free(clients);
+    return failures > 0;
+}
@@ -0,0 +1,293 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the request scheduler shared by the otp daemons
+ * Each request first pays its client's token buckets, sleeping off any
+ * deficit, then queues for one of maxConcurrent transform turns
+ * Turns go to the smallest virtual finish tag (start + bytes / weight),
+ * so a client sending small requests is served ahead of one streaming
+ * large ones, while a lone bulk client still uses all spare turns
+ * Small requests also queue separately in a fast lane with turns of its
+ * own and first claim on free bulk turns, so a short request never waits
+ * behind a run of large transforms, even from the same address
+*******************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include "otp_sched.h"
+#include "otp_metrics.h"
+
+#define SCHED_POLL_NANOS 100000000ULL   // Check for dead waiters this often while queued
+
+struct schedConfig schedConfig = { 0.0, 0.0, 0, 4096, 1, 0 };
+
+static struct daemonScheduler* scheduler = NULL;
+
+/*******************************************************************************
+ * Map the scheduler as shared memory before any worker is forked
+ * The lock is robust so a worker killed while holding it cannot wedge the rest
+*******************************************************************************/
+void initScheduler()
+{
+    pthread_mutexattr_t mutexAttributes;
+    pthread_condattr_t condAttributes;
+
+    scheduler = mmap(NULL, sizeof(struct daemonScheduler), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (scheduler == MAP_FAILED) { error("scheduler: ERROR mapping shared memory"); }
+    memset(scheduler, 0, sizeof(struct daemonScheduler));
+
+    pthread_mutexattr_init(&mutexAttributes);
+    pthread_mutexattr_setpshared(&mutexAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexAttributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&scheduler->lock, &mutexAttributes);
+    pthread_mutexattr_destroy(&mutexAttributes);
+
+    pthread_condattr_init(&condAttributes);
+    pthread_condattr_setpshared(&condAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&condAttributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&scheduler->turnChanged, &condAttributes);
+    pthread_condattr_destroy(&condAttributes);
+}
+
+/*******************************************************************************
+ * Parse an "address=weight" rule giving that client a larger fair share
+ * Returns false if the rule is malformed or too many were given
+*******************************************************************************/
+bool addSchedWeight(const char* rule)
+{
+    char address[INET_ADDRSTRLEN];
+    char* end = NULL;
+    const char* equals = strchr(rule, '=');
+
+    if (!equals || (size_t)(equals - rule) >= sizeof(address)) { return false; }
+    if (schedConfig.numWeights == SCHED_MAX_WEIGHTS) { return false; }
+
+    memcpy(address, rule, (size_t)(equals - rule));
+    address[equals - rule] = '\0';
+
+    int index = schedConfig.numWeights;
+    if (inet_pton(AF_INET, address, &schedConfig.weightAddresses[index]) != 1) { return false; }
+
+    schedConfig.weights[index] = strtod(equals + 1, &end);
+    if (*end != '\0' || schedConfig.weights[index] <= 0) { return false; }
+
+    schedConfig.numWeights++;
+    return true;
+}
+
+/*******************************************************************************
+ * Lock the scheduler, recovering it if the previous holder died
+*******************************************************************************/
+static void lockScheduler()
+{
+    if (pthread_mutex_lock(&scheduler->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&scheduler->lock);
+    }
+}
+
+/*******************************************************************************
+ * Returns the configured weight of passed-in address, 1 by default
+*******************************************************************************/
+static double weightOf(uint32_t address)
+{
+    for (int i = 0; i < schedConfig.numWeights; i++) {
+        if (schedConfig.weightAddresses[i] == address) { return schedConfig.weights[i]; }
+    }
+    return 1.0;
+}
+
+/*******************************************************************************
+ * Find passed-in address in the client table, adding it if new
+ * A full probe sequence evicts its idlest client, which only forgets history
+*******************************************************************************/
+static struct schedClient* findClient(uint32_t address, unsigned long long now)
+{
+    unsigned int start = (address * 2654435761u) % SCHED_CLIENT_SLOTS;     // Multiplicative hash
+    struct schedClient* idlest = NULL;
+
+    for (int probe = 0; probe < SCHED_CLIENT_PROBES; probe++) {
+        struct schedClient* client = &scheduler->clients[(start + probe) % SCHED_CLIENT_SLOTS];
+        if (client->used && client->address == address) { return client; }
+        if (!client->used) { idlest = client; break; }
+        if (!idlest || client->lastRefill < idlest->lastRefill) { idlest = client; }
+    }
+
+    // New clients start with full buckets: one second's worth of each rate
+    idlest->used = true;
+    idlest->address = address;
+    idlest->weight = weightOf(address);
+    idlest->requestTokens = schedConfig.requestsPerSecond;
+    idlest->byteTokens = schedConfig.bytesPerSecond;
+    idlest->lastRefill = now;
+    idlest->lastFinish = 0.0;
+    return idlest;
+}
+
+/*******************************************************************************
+ * Refill passed-in bucket for elapsed seconds, capped at one second's worth,
+ * then take cost from it; returns the seconds to wait if it went into debt
+*******************************************************************************/
+static double takeTokens(double* tokens, double rate, double elapsed, double cost)
+{
+    if (rate <= 0) { return 0.0; }
+
+    *tokens += elapsed * rate;
+    if (*tokens > rate) { *tokens = rate; }
+    *tokens -= cost;
+
+    return *tokens < 0 ? -*tokens / rate : 0.0;
+}
+
+/*******************************************************************************
+ * Free the turns of workers that died while queued or running
+*******************************************************************************/
+static void reapDeadWaiters()
+{
+    for (int i = 0; i < SCHED_WAITER_SLOTS; i++) {
+        struct schedWaiter* waiter = &scheduler->waiters[i];
+        if (waiter->state != WAITER_FREE && kill(waiter->pid, 0) < 0 && errno == ESRCH) {
+            waiter->state = WAITER_FREE;
+            pthread_cond_broadcast(&scheduler->turnChanged);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Returns the lane whose turn passed-in ticket may take now, or -1 to wait
+ * Within a lane, the smallest finish tag goes first (ties to the lower slot)
+ * Fast-lane requests use their own turns, then free bulk turns;
+ * bulk requests take bulk turns only while no fast-lane request is queued
+*******************************************************************************/
+static int freeTurn(int ticket)
+{
+    int running[NUM_SCHED_LANES] = {0};
+    bool fastQueued = false;
+    struct schedWaiter* me = &scheduler->waiters[ticket];
+
+    for (int i = 0; i < SCHED_WAITER_SLOTS; i++) {
+        struct schedWaiter* waiter = &scheduler->waiters[i];
+        if (waiter->state == WAITER_RUNNING) { running[waiter->turnLane]++; }
+        if (waiter->state != WAITER_QUEUED || i == ticket) { continue; }
+
+        if (waiter->lane == LANE_FAST) { fastQueued = true; }
+        if (waiter->lane == me->lane &&
+            (waiter->finishTag < me->finishTag || (waiter->finishTag == me->finishTag && i < ticket))) { return -1; }
+    }
+
+    if (me->lane == LANE_FAST && running[LANE_FAST] < schedConfig.fastLaneTurns) { return LANE_FAST; }
+    if ((me->lane == LANE_FAST || !fastQueued) && running[LANE_BULK] < schedConfig.maxConcurrent) { return LANE_BULK; }
+    return -1;
+}
+
+/*******************************************************************************
+ * Sleep for passed-in seconds, resuming after signals
+*******************************************************************************/
+static void sleepSeconds(double seconds)
+{
+    struct timespec remaining;
+    remaining.tv_sec = (time_t)seconds;
+    remaining.tv_nsec = (long)((seconds - (double)remaining.tv_sec) * 1e9);
+
+    while (nanosleep(&remaining, &remaining) < 0 && errno == EINTR) {}
+}
+
+/*******************************************************************************
+ * Wait until a request of passed-in bytes from passed-in address may be
+ * transformed: first pay its rate limits, then wait for its fair turn
+ * Returns a ticket to hand back to finishRequest once the transform is done
+*******************************************************************************/
+int admitRequest(uint32_t address, size_t bytes)
+{
+    bool limited = schedConfig.requestsPerSecond > 0 || schedConfig.bytesPerSecond > 0;
+    double startTag = 0.0, finishTag = 0.0, delay = 0.0;
+    int ticket = -1;
+
+    if (!scheduler || (!limited && schedConfig.maxConcurrent <= 0)) { return -1; }
+
+    // Charge the client's buckets and assign its fair-queuing tags
+    unsigned long long now = monotonicNanos();
+    lockScheduler();
+    struct schedClient* client = findClient(address, now);
+
+    double elapsed = (double)(now - client->lastRefill) / 1e9;
+    client->lastRefill = now;
+    double requestDelay = takeTokens(&client->requestTokens, schedConfig.requestsPerSecond, elapsed, 1.0);
+    double byteDelay = takeTokens(&client->byteTokens, schedConfig.bytesPerSecond, elapsed, (double)bytes);
+    delay = requestDelay > byteDelay ? requestDelay : byteDelay;
+
+    startTag = scheduler->virtualTime > client->lastFinish ? scheduler->virtualTime : client->lastFinish;
+    finishTag = startTag + (double)(bytes + 1) / client->weight;                // Empty requests still cost
+    client->lastFinish = finishTag;
+    pthread_mutex_unlock(&scheduler->lock);
+
+    // Over its rate: sleep off the debt before competing for a turn
+    if (delay > 0) {
+        countMetric(MC_THROTTLED, 1);
+        countMetric(MC_THROTTLE_NS, (unsigned long long)(delay * 1e9));
+        sleepSeconds(delay);
+    }
+
+    if (schedConfig.maxConcurrent <= 0) { return -1; }
+
+    // Queue, then wait for the smallest finish tag and a free turn
+    unsigned long long queueStart = monotonicNanos();
+    bool queued = false;
+    lockScheduler();
+
+    for (int i = 0; i < SCHED_WAITER_SLOTS && ticket < 0; i++) {
+        if (scheduler->waiters[i].state == WAITER_FREE) { ticket = i; }
+    }
+    if (ticket < 0) {
+        pthread_mutex_unlock(&scheduler->lock);             // Queue full: run unscheduled
+        return -1;
+    }
+    struct schedWaiter* me = &scheduler->waiters[ticket];
+    me->pid = getpid();
+    me->finishTag = finishTag;
+    me->lane = schedConfig.fastLaneTurns > 0 && bytes <= schedConfig.fastLaneBytes ? LANE_FAST : LANE_BULK;
+    me->state = WAITER_QUEUED;
+
+    int lane;
+    while ((lane = freeTurn(ticket)) < 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += SCHED_POLL_NANOS;
+        if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+
+        queued = true;
+        int status = pthread_cond_timedwait(&scheduler->turnChanged, &scheduler->lock, &deadline);
+        if (status == EOWNERDEAD) { pthread_mutex_consistent(&scheduler->lock); }
+        if (status == ETIMEDOUT) { reapDeadWaiters(); }
+    }
+
+    me->turnLane = lane;
+    me->state = WAITER_RUNNING;
+    if (startTag > scheduler->virtualTime) { scheduler->virtualTime = startTag; }
+    if (queued) { pthread_cond_broadcast(&scheduler->turnChanged); }      // Next in line may fit too
+    pthread_mutex_unlock(&scheduler->lock);
+
+    if (me->lane == LANE_FAST) { countMetric(MC_FAST_LANE, 1); }
+    if (queued) {
+        countMetric(MC_QUEUED, 1);
+        recordLatency(MH_QUEUE_US, monotonicNanos() - queueStart);
+    }
+    return ticket;
+}
+
+/*******************************************************************************
+ * Give back the turn held by passed-in ticket and wake the queue
+*******************************************************************************/
+void finishRequest(int ticket)
+{
+    if (ticket < 0) { return; }
+
+    lockScheduler();
+    scheduler->waiters[ticket].state = WAITER_FREE;
+    pthread_cond_broadcast(&scheduler->turnChanged);
+    pthread_mutex_unlock(&scheduler->lock);
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the request scheduler shared by the otp daemons:
+ *   per-client token buckets for requests/s and bytes/s
+ *   weighted fair queuing of transforms when at most maxConcurrent may run
+ *   a fast lane of extra turns reserved for small requests
+ *   state kept in shared memory so every forked worker sees the same queue
+*******************************************************************************/
+
+#ifndef OTP_SCHED_H
+#define OTP_SCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "otp_helpers.h"
+
+#define SCHED_CLIENT_SLOTS 256          // Clients tracked at once; idlest is evicted when full
+#define SCHED_CLIENT_PROBES 8
+#define SCHED_WAITER_SLOTS 64           // Workers queued or running; extras bypass the queue
+#define SCHED_MAX_WEIGHTS 16
+
+// Limits set from the daemon's command line; zero means unlimited
+struct schedConfig {
+    double requestsPerSecond;
+    double bytesPerSecond;
+    int maxConcurrent;                  // Bulk transforms running at once across all workers
+    size_t fastLaneBytes;               // Requests up to this size use the fast lane
+    int fastLaneTurns;                  // Turns only fast-lane requests may take
+    int numWeights;
+    uint32_t weightAddresses[SCHED_MAX_WEIGHTS];    // Network byte order
+    double weights[SCHED_MAX_WEIGHTS];
+};
+
+// Token buckets and fair-queuing tag of one source address
+struct schedClient {
+    uint32_t address;
+    bool used;
+    double weight;
+    double requestTokens;
+    double byteTokens;
+    unsigned long long lastRefill;
+    double lastFinish;                  // Virtual finish time of its latest request
+};
+
+enum waiterState { WAITER_FREE, WAITER_QUEUED, WAITER_RUNNING };
+enum schedLane { LANE_BULK, LANE_FAST, NUM_SCHED_LANES };
+
+struct schedWaiter {
+    pid_t pid;
+    int state;
+    int lane;                           // Lane the request queues in
+    int turnLane;                       // Lane whose turn it holds while running
+    double finishTag;
+};
+
+struct daemonScheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t turnChanged;
+    double virtualTime;
+    struct schedClient clients[SCHED_CLIENT_SLOTS];
+    struct schedWaiter waiters[SCHED_WAITER_SLOTS];
+};
+
+extern struct schedConfig schedConfig;
+
+void initScheduler();
+bool addSchedWeight(const char* rule);
+int admitRequest(uint32_t address, size_t bytes);
+void finishRequest(int ticket);
+
+#endif //OTP_SCHED_H
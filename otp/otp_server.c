@@ -0,0 +1,719 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the server side shared by otp_enc_d and otp_dec_d
+ *   creates and validates connection to the matching client
+ *   receives key and message and sends transformed message back to client
+ *   supports up to 5 concurrent socket connections
+ *   verifies CRC32C-checked frames and asks for a resend when they fail
+ *   rate-limits each client and shares transform turns fairly between them
+ *   flags (or refuses) keys reused with a different message
+ *   or, with -T, serves every connection from threads (otp_threaded.c)
+ *   can record a trace of every request for otp_replay
+ *   restarts without refusing connections: on SIGHUP a new daemon inherits
+ *   the listening socket, and this one drains its workers and exits
+ *   keeps live metrics readable on SIGUSR1 or over a stats socket
+*******************************************************************************/
+
+#define _GNU_SOURCE                     // pipe2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "otp_server.h"
+#include "otp_metrics.h"
+#include "otp_sched.h"
+#include "otp_buffers.h"
+#include "otp_keyindex.h"
+#include "otp_threaded.h"
+#include "otp_trace.h"
+
+#define LISTEN_FD_ENV "OTP_LISTEN_FD"  // Listening socket inherited across a restart
+#define READY_FD_ENV "OTP_READY_FD"    // Pipe the new daemon reports readiness on
+#define READY_TIMEOUT_MS 10000          // Keep serving if the new daemon is not ready by then
+#define DRAIN_TIMEOUT_SECONDS 30        // Then remaining workers are terminated
+
+const char* serverName = "otp_d";
+char* statsSocketPath = NULL;
+
+static char** serverArgv = NULL;
+static pid_t* workerPIDs = NULL;
+static int numWorkers = 0;
+static int workerCapacity = 0;
+static volatile sig_atomic_t restartRequested = false;
+static volatile sig_atomic_t drainRequested = false;
+
+/******************************************************************************
+ * Print usage message and exit
+*******************************************************************************/
+static void serverUsage(char *program)
+{
+    fprintf(stderr, "USAGE: %s [-s statsSocket] [-r requests/s] [-b bytes/s] "
+                    "[-c concurrent] [-f fastBytes] [-F fastTurns] [-w address=weight]... "
+                    "[-p bufferSlots] [-k off|flag|reject] [-T] [-R trace [-D]] port\n", program);
+    exit(1);
+}
+
+/******************************************************************************
+ * Parse daemon options and return the port number
+ *   -s path       serve metrics on an AF_UNIX stats socket at path
+ *   -r rate       limit each client to rate requests per second
+ *   -b rate       limit each client to rate message bytes per second
+ *   -c count      run at most count transforms at once, shared fairly
+ *                 between clients (default: one per CPU, 0 for no limit)
+ *   -f bytes      requests up to bytes long use the fast lane (default 4096)
+ *   -F count      turns reserved for the fast lane (default 1, 0 disables it)
+ *   -w addr=wt    give client addr wt times the default fair share
+ *   -p count      workers that get pre-faulted buffers from reserved huge
+ *                 pages (default 8); others map their own
+ *   -k policy     on key reuse: off, flag it in the metrics (default),
+ *                 or reject the request
+ *   -T            threaded: I/O threads and a transform thread pool instead
+ *                 of a process per connection; -c sets the pool size and
+ *                 fast-lane requests are transformed on the I/O threads
+ *   -R path       append a record of every request to the trace at path
+ *   -D            include each request's key and message in the trace
+ * Exit with usage message if arguments are invalid
+*******************************************************************************/
+int parseServerArgs(int argc, char *argv[])
+{
+    int option = -5;
+    char *end = NULL;
+
+    serverArgv = argv;                                              // Re-executed on restart
+    schedConfig.maxConcurrent = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((option = getopt(argc, argv, "s:r:b:c:f:F:w:p:k:TR:D")) != -1) {
+        switch (option) {
+            case 's':
+                statsSocketPath = optarg;
+                break;
+
+            case 'r':
+                schedConfig.requestsPerSecond = strtod(optarg, &end);
+                if (*end != '\0' || schedConfig.requestsPerSecond < 0) { serverUsage(argv[0]); }
+                break;
+
+            case 'b':
+                schedConfig.bytesPerSecond = strtod(optarg, &end);
+                if (*end != '\0' || schedConfig.bytesPerSecond < 0) { serverUsage(argv[0]); }
+                break;
+
+            case 'c':
+                schedConfig.maxConcurrent = (int)strtol(optarg, &end, 10);
+                if (*end != '\0' || schedConfig.maxConcurrent < 0) { serverUsage(argv[0]); }
+                break;
+
+            case 'f':
+                schedConfig.fastLaneBytes = (size_t)strtoull(optarg, &end, 10);
+                if (*end != '\0') { serverUsage(argv[0]); }
+                break;
+
+            case 'F':
+                schedConfig.fastLaneTurns = (int)strtol(optarg, &end, 10);
+                if (*end != '\0' || schedConfig.fastLaneTurns < 0) { serverUsage(argv[0]); }
+                break;
+
+            case 'w':
+                if (!addSchedWeight(optarg)) { serverUsage(argv[0]); }
+                break;
+
+            case 'p':
+                bufferSlots = (int)strtol(optarg, &end, 10);
+                if (*end != '\0' || bufferSlots < 0) { serverUsage(argv[0]); }
+                break;
+
+            case 'k':
+                if (!setKeyReusePolicy(optarg)) { serverUsage(argv[0]); }
+                break;
+
+            case 'T':
+                threadedMode = true;
+                break;
+
+            case 'R':
+                tracePath = optarg;
+                break;
+
+            case 'D':
+                tracePayloads = true;
+                break;
+
+            default:
+                serverUsage(argv[0]);
+        }
+    }
+
+    // Check usage & args
+    if (optind != argc - 1 || atoi(argv[optind]) < 0) {
+        serverUsage(argv[0]);
+    }
+
+    // Rate limits and weights live in the forked workers' scheduler
+    if (threadedMode && (schedConfig.requestsPerSecond > 0 || schedConfig.bytesPerSecond > 0 ||
+                         schedConfig.numWeights > 0)) {
+        fprintf(stderr, "%s: -r, -b and -w are not supported with -T\n", argv[0]);
+        exit(1);
+    }
+
+    return atoi(argv[optind]);
+}
+
+/******************************************************************************
+ * Signal handlers only set flags; the accept and receive loops act on them
+ * SIGCHLD has a handler so that it interrupts accept() for reaping
+*******************************************************************************/
+static void catchSIGHUP(int signalNum) { restartRequested = true; }
+static void catchSIGUSR2(int signalNum) { drainRequested = true; }
+static void catchSIGCHLD(int signalNum) {}
+
+/******************************************************************************
+ * Install the restart, drain and child-exit handlers without SA_RESTART
+ * Workers inherit SIGUSR2: finish the current request, then exit
+*******************************************************************************/
+static void installServerSignals()
+{
+    struct sigaction action = {{0}};
+    sigfillset(&action.sa_mask);
+    action.sa_flags = 0;
+
+    action.sa_handler = catchSIGHUP;
+    sigaction(SIGHUP, &action, NULL);
+    action.sa_handler = catchSIGUSR2;
+    sigaction(SIGUSR2, &action, NULL);
+    action.sa_handler = catchSIGCHLD;
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+/******************************************************************************
+ * Return the listening socket inherited from the daemon this one replaces,
+ * or create, bind and listen on a new one for passed-in port number
+*******************************************************************************/
+static int openListenSocket(int portNumber)
+{
+    int listenSocketFD;
+    struct sockaddr_in serverAddress;
+    const char* inherited = getenv(LISTEN_FD_ENV);
+
+    if (inherited) {
+        int acceptsConnections = 0;
+        socklen_t optionLength = sizeof(acceptsConnections);
+
+        listenSocketFD = atoi(inherited);
+        unsetenv(LISTEN_FD_ENV);
+        if (getsockopt(listenSocketFD, SOL_SOCKET, SO_ACCEPTCONN, &acceptsConnections, &optionLength) < 0 ||
+            !acceptsConnections) {
+            fprintf(stderr, "%s: inherited fd %d is not a listening socket\n", serverName, listenSocketFD);
+            exit(1);
+        }
+        fcntl(listenSocketFD, F_SETFD, FD_CLOEXEC);
+        return listenSocketFD;
+    }
+
+    // Set up the address struct for this process (the server)
+    memset((char *)&serverAddress, '\0', sizeof(serverAddress));    // Clear out the address struct
+    serverAddress.sin_family = AF_INET;                             // Create a network-capable socket
+    serverAddress.sin_port = htons(portNumber);                     // Store the port number
+    serverAddress.sin_addr.s_addr = INADDR_ANY;                     // Any address is allowed for connection to this process
+
+    // Create the socket
+    if ((listenSocketFD = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        fprintf(stderr, "%s: ", serverName);
+        error("ERROR opening socket");
+    }
+
+    // Enable the socket to begin listening - connect socket to port
+    if (bind(listenSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0) {
+        fprintf(stderr, "%s: ", serverName);
+        error("ERROR on binding");
+    }
+
+    // Flip the socket on - it can now receive up to 5 connections
+    listen(listenSocketFD, NUM_CONNECTIONS);
+    return listenSocketFD;
+}
+
+/******************************************************************************
+ * Tell the daemon that started this one, if any, that it is ready to accept
+*******************************************************************************/
+static void reportReady()
+{
+    const char* readyFD = getenv(READY_FD_ENV);
+    if (!readyFD) { return; }
+
+    int fd = atoi(readyFD);
+    unsetenv(READY_FD_ENV);
+    if (write(fd, "R", 1) < 0) { perror("ready pipe"); }
+    close(fd);
+}
+
+/******************************************************************************
+ * Remember a forked worker so it can be drained on restart
+*******************************************************************************/
+static void trackWorker(pid_t workerPID)
+{
+    if (numWorkers == workerCapacity) {
+        workerCapacity = workerCapacity ? workerCapacity * 2 : 64;
+        workerPIDs = realloc(workerPIDs, (size_t)workerCapacity * sizeof(pid_t));
+        if (!workerPIDs) { error("realloc"); }
+    }
+    workerPIDs[numWorkers++] = workerPID;
+}
+
+/******************************************************************************
+ * Reap every exited child without blocking and forget finished workers
+*******************************************************************************/
+static void reapWorkers()
+{
+    pid_t exitedPID;
+
+    while ((exitedPID = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int i = 0; i < numWorkers; i++) {
+            if (workerPIDs[i] == exitedPID) {
+                workerPIDs[i] = workerPIDs[--numWorkers];
+                break;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * Start a new copy of this daemon that inherits passed-in listening socket,
+ * run from the same path and arguments so a replaced binary takes effect
+ * Returns true once it reports ready; false if it failed to start, in
+ * which case this daemon simply keeps serving
+*******************************************************************************/
+static bool startReplacement(int listenSocketFD)
+{
+    int readyPipe[2];
+    char readyByte = '\0';
+
+    if (pipe2(readyPipe, O_CLOEXEC) < 0) { perror("pipe2"); return false; }
+
+    pid_t replacementPID = fork();
+    if (replacementPID < 0) {
+        perror("fork");
+        close(readyPipe[0]);
+        close(readyPipe[1]);
+        return false;
+    }
+
+    if (replacementPID == 0) {
+        char fdString[16];
+
+        // Only the listening socket and the ready pipe survive the exec
+        fcntl(listenSocketFD, F_SETFD, 0);
+        fcntl(readyPipe[1], F_SETFD, 0);
+        snprintf(fdString, sizeof(fdString), "%d", listenSocketFD);
+        setenv(LISTEN_FD_ENV, fdString, 1);
+        snprintf(fdString, sizeof(fdString), "%d", readyPipe[1]);
+        setenv(READY_FD_ENV, fdString, 1);
+
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGUSR2, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        execvp(serverArgv[0], serverArgv);                      // By path, so a newly installed binary runs
+        perror("execvp");
+        _exit(1);
+    }
+
+    // Wait for the new daemon to take over accepting
+    close(readyPipe[1]);
+    struct pollfd ready = { .fd = readyPipe[0], .events = POLLIN };
+    int pollResult;
+    while ((pollResult = poll(&ready, 1, READY_TIMEOUT_MS)) < 0 && errno == EINTR) {}
+    bool started = pollResult > 0 && read(readyPipe[0], &readyByte, 1) == 1;
+    close(readyPipe[0]);
+
+    if (!started) {
+        fprintf(stderr, "%s: restart failed, still serving\n", serverName);
+        kill(replacementPID, SIGTERM);
+    }
+    return started;
+}
+
+/******************************************************************************
+ * Stop accepting, let every worker finish its current request, then exit
+ * Workers idle between requests close their connections at once; pooled
+ * clients reconnect, reaching the new daemon
+*******************************************************************************/
+static void drainAndExit(int listenSocketFD)
+{
+    close(listenSocketFD);
+
+    for (int i = 0; i < numWorkers; i++) { kill(workerPIDs[i], SIGUSR2); }
+
+    unsigned long long deadline = monotonicNanos() + DRAIN_TIMEOUT_SECONDS * 1000000000ULL;
+    while (1) {
+        reapWorkers();
+        if (numWorkers == 0) { break; }
+
+        if (monotonicNanos() > deadline) {
+            fprintf(stderr, "%s: %d workers still busy after %ds, terminating\n",
+                    serverName, numWorkers, DRAIN_TIMEOUT_SECONDS);
+            for (int i = 0; i < numWorkers; i++) { kill(workerPIDs[i], SIGTERM); }
+            break;
+        }
+
+        struct timespec pause = { 0, 50000000L };
+        nanosleep(&pause, NULL);
+    }
+
+    exit(0);
+}
+
+/******************************************************************************
+ * Set up server info with passed-in port number
+ * Create listening socket and listen for connections
+ * Spawn a child process for up to 5 connections
+ * Each child serves requests until its client closes the connection
+ * or the daemon is restarted (SIGHUP)
+ * For each connection, validate connected to the matching client
+ * Receive message and key text from client and send back transformed text
+*******************************************************************************/
+void beginListening(int portNumber)
+{
+    int listenSocketFD, establishedConnectionFD;
+    socklen_t sizeOfClientInfo;
+    struct sockaddr_in clientAddress;
+    uint32_t numAccepted = 0;
+
+    // Set up shared metrics, scheduler, buffers and key index before any worker is forked
+    initMetrics();
+    if (!threadedMode) {
+        initScheduler();
+        initBufferPool();
+    }
+    initKeyIndex();
+    openTrace();
+    installMetricsDumpHandler();
+    if (statsSocketPath) { startStatsServer(statsSocketPath, serverName); }
+
+    installServerSignals();
+    listenSocketFD = openListenSocket(portNumber);
+    if (threadedMode) { startThreadedServer(); }
+    reportReady();
+
+    // Continue listening until socket closed
+    while(1) {
+
+        // Dump metrics to stderr if SIGUSR1 arrived while waiting
+        if (metricsDumpRequested) {
+            metricsDumpRequested = false;
+            writeMetrics(stderr, serverName);
+        }
+
+        // Hand the socket to a new daemon on SIGHUP, then drain and exit
+        if (restartRequested) {
+            restartRequested = false;
+            if (startReplacement(listenSocketFD)) {
+                if (threadedMode) { drainThreadedAndExit(listenSocketFD); }
+                drainAndExit(listenSocketFD);
+            }
+        }
+        reapWorkers();
+
+        // Accept a connection, blocking if one is not available until one connects
+        sizeOfClientInfo = sizeof(clientAddress);                       // Get the size of the address for the client that will connect
+        establishedConnectionFD = accept(listenSocketFD, (struct sockaddr *)&clientAddress, &sizeOfClientInfo);
+        if (establishedConnectionFD < 0) {
+            if (errno == EINTR) { continue; }                           // Interrupted by a signal
+            fprintf(stderr, "%s: ", serverName);
+            error("ERROR on accept");
+        }
+        countMetric(MC_CONN_ACCEPTED, 1);
+        uint64_t traceConnection = traceConnectionID(numAccepted++);
+
+        // The message ack and the reply are back-to-back writes; without
+        // TCP_NODELAY the reply waits for the client's delayed ACK (~40ms)
+        int noDelay = 1;
+        setsockopt(establishedConnectionFD, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        if (threadedMode) {
+            handThreadedConnection(establishedConnectionFD, clientAddress.sin_addr.s_addr, traceConnection);
+            continue;
+        }
+
+        pid_t childPID = fork();
+        switch(childPID) {
+            case -1:
+                perror("fork"); exit(1);
+                break;
+
+            case 0:
+                claimMetricsSlot(getpid());
+                claimBufferSlot();
+                close(listenSocketFD);                              // Close the listening socket
+
+                // Check connected to matching client ONLY; the connection keeps its mode
+                char mode = checkClientConnection(establishedConnectionFD);
+                if (!mode) {
+                    close(establishedConnectionFD);
+                    exit(1);
+                }
+
+                // Serve requests on this connection until the client closes it
+                char *receivedKey = poolAlloc(BUFFER_SIZE);
+                char *receivedMessage = poolAlloc(BUFFER_SIZE);
+                char *key, *message;
+                int keyFrame;
+                while ((keyFrame = receiveAcknowledgedMessage(establishedConnectionFD, receivedKey, &key, OTP_KEY_ACK)) != FRAME_CLOSED) {
+                    unsigned long long requestStart = monotonicNanos();
+
+                    // Receive message from client
+                    if (receiveAcknowledgedMessage(establishedConnectionFD, receivedMessage, &message, OTP_MESSAGE_ACK) == FRAME_CLOSED) { break; }
+
+                    // Wait for this client's rate limit and fair turn
+                    size_t length = strlen(message);
+                    int ticket = admitRequest(clientAddress.sin_addr.s_addr, length);
+
+                    // Transform message, checksumming the result if the client checks frames
+                    unsigned long long transformStart = monotonicNanos();
+                    char* transformedMessage = poolAlloc(length + 1);
+
+                    uint32_t checksum = 0;
+                    int status = keyFrame == FRAME_CHECKED
+                        ? otpTransformChecksum(mode, key, strlen(key), message, length, transformedMessage, length + 1, &checksum)
+                        : otpTransform(mode, key, strlen(key), message, length, transformedMessage, length + 1);
+                    finishRequest(ticket);
+                    if (status != OTP_OK) {
+                        fprintf(stderr, "%s: ERROR %s\n", serverName, otpStatusString(status));
+                        poolFree(transformedMessage, length + 1);
+                        break;
+                    }
+                    unsigned long long transformNanos = monotonicNanos() - transformStart;
+                    countMetric(MC_TRANSFORMS, 1);
+                    countMetric(mode == OTP_ENCRYPT ? MC_ENCRYPTS : MC_DECRYPTS, 1);
+                    countMetric(MC_TRANSFORM_NS, transformNanos);
+                    recordLatency(MH_TRANSFORM_US, transformNanos);
+
+                    // A key already used with another message is flagged, or refused
+                    if (indexKeyWindows(mode, key, message, length) > 0) {
+                        countMetric(MC_KEY_REUSE, 1);
+                        if (keyReusePolicy == KEY_REUSE_REJECT) {
+                            fprintf(stderr, "%s: ERROR key reused with a different message\n", serverName);
+                            poolFree(transformedMessage, length + 1);
+                            break;
+                        }
+                    }
+
+                    // Send back to client in the same framing it used
+                    if (keyFrame == FRAME_CHECKED) { sendChecked(establishedConnectionFD, transformedMessage, length, checksum); }
+                    else { sendWithTerminator(establishedConnectionFD, transformedMessage); }
+                    recordLatency(MH_REQUEST_US, monotonicNanos() - requestStart);
+                    recordTrace(traceConnection, mode, keyFrame == FRAME_CHECKED, requestStart,
+                                key, strlen(key), message, length);
+
+                    poolFree(transformedMessage, length + 1);
+                }
+
+                close(establishedConnectionFD);                     // Close the existing socket which is connected to the client
+                exit(0);
+
+            default:
+                close(establishedConnectionFD);                     // Child owns the connection
+                trackWorker(childPID);
+                break;
+        }
+    }
+}
+
+/******************************************************************************
+ * Returns the mode a client sending passed-in programID may continue in:
+ * its own if this daemon serves it ('E' for encryption, 'D' for decryption,
+ * either for SERVE_ANY_MODE), else '\0'
+*******************************************************************************/
+char acceptedMode(char clientID)
+{
+    bool accepted = programID == SERVE_ANY_MODE ? (clientID == OTP_ENCRYPT || clientID == OTP_DECRYPT)
+                                                : clientID == programID;
+    return accepted ? clientID : '\0';
+}
+
+/******************************************************************************
+ * Receive the programID from the client over passed-in socket
+ * Send back either 'S' or 'F' for successful or failed check
+ * Return the mode the client may continue in, or '\0' if refused
+*******************************************************************************/
+char checkClientConnection(int socketFD)
+{
+    char clientID;
+
+    int charRead = recv(socketFD, &clientID, sizeof(char), 0);
+
+    // Check for error in client response
+    if (charRead <= 0) {
+        countMetric(MC_HANDSHAKE_FAILURES, 1);
+        return '\0';
+    }
+
+    if (!acceptedMode(clientID)) {
+        countMetric(MC_CONN_REJECTED, 1);
+        sendServerResponse(socketFD, "F");                          // Failed connection
+        return '\0';
+    }
+
+    // Else send success response
+    sendServerResponse(socketFD, "S");                              // Successful connection
+    return clientID;
+}
+
+/******************************************************************************
+ * Look for one whole frame at the start of passed-in null-terminated buffer
+ * Every frame ends at its first terminator, searched for from searchFrom on
+ * (earlier chars held none): no payload symbol, header digit or ';' is '@',
+ * so a frame whose header is corrupt still ends there, and the next one
+ * starts after it. A checked frame's terminator must then sit at the length
+ * its header declares, and its CRC32C match payload and length
+ * On success *payload points at the null-terminated text within buffer;
+ * unless more chars are needed *frameLength is the number of chars the
+ * frame took up, through its terminator
+ * Returns one of enum frameResult, FRAME_INCOMPLETE if more chars are needed
+*******************************************************************************/
+int parseClientFrame(char* buffer, size_t searchFrom, char** payload, size_t* frameLength)
+{
+    char* terminator = strstr(buffer + searchFrom, TERMINATOR);
+    if (!terminator) { return FRAME_INCOMPLETE; }
+    *frameLength = (size_t)(terminator - buffer) + strlen(TERMINATOR);
+
+    // Checked frame: a terminator early or late, or a bad checksum, is corrupt
+    if (buffer[0] == OTP_FRAME_MAGIC) {
+        char* text = buffer + OTP_FRAME_HEADER_SIZE;
+        size_t declaredLength = 0;
+        uint32_t declaredChecksum = 0;
+
+        if (terminator < text ||
+            otpParseFrameHeader(buffer, &declaredLength, &declaredChecksum) != OTP_OK ||
+            declaredLength != (size_t)(terminator - text) ||
+            otpFrameChecksum(buffer, otpCrc32c(0, text, declaredLength)) != declaredChecksum) {
+            return FRAME_CORRUPT;
+        }
+
+        *terminator = '\0';
+        *payload = text;
+        return FRAME_CHECKED;
+    }
+
+    // Plain frame: "delete" terminal symbols by replacing with null terminator
+    *terminator = '\0';
+    *payload = buffer;
+    return FRAME_PLAIN;
+}
+
+/******************************************************************************
+ * Read one frame from the client over the passed-in socket into clientMessage
+ * On success *payload points at the null-terminated text within clientMessage
+ * Returns one of enum frameResult other than FRAME_INCOMPLETE
+*******************************************************************************/
+int receiveTerminatedClientMessage(int connectionFD, char clientMessage[], char** payload)
+{
+    size_t totalChars = 0;
+    size_t frameLength = 0;
+    int result = FRAME_INCOMPLETE;
+
+    // Read until the terminator has arrived, even after a corrupt header
+    while (result == FRAME_INCOMPLETE) {
+        // Restarting: stop between requests, unless the next one has already arrived
+        if (drainRequested && totalChars == 0) {
+            char next;
+            if (recv(connectionFD, &next, 1, MSG_PEEK | MSG_DONTWAIT) <= 0) { return FRAME_CLOSED; }
+        }
+
+        if (totalChars == BUFFER_SIZE - 1) {
+            fprintf(stderr, "%s: ERROR message too long\n", serverName);
+            return FRAME_CLOSED;
+        }
+
+        ssize_t charsRead = recv(connectionFD, clientMessage + totalChars, BUFFER_SIZE - 1 - totalChars, 0);
+        if (charsRead == 0 && totalChars == 0) {
+            return FRAME_CLOSED;                                // Closed between requests
+        }
+        if (charsRead < 0 && errno == EINTR) { continue; }
+        if (charsRead <= 0) {
+            fprintf(stderr, "%s: ERROR reading from socket\n", serverName);
+            return FRAME_CLOSED;
+        }
+
+        // Only the new chars (and one before, in case "@@" was split) need searching
+        size_t searchFrom = totalChars > 0 ? totalChars - 1 : 0;
+        totalChars += (size_t)charsRead;
+        clientMessage[totalChars] = '\0';
+
+        result = parseClientFrame(clientMessage, searchFrom, payload, &frameLength);
+    }
+
+    countMetric(MC_BYTES_IN, (unsigned long long)totalChars);
+
+    // Clients wait for each ack, so nothing may follow a checked frame
+    if (result == FRAME_CHECKED && totalChars != frameLength) { return FRAME_CORRUPT; }
+    return result;
+}
+
+/******************************************************************************
+ * Receive one frame and answer with passed-in ack, asking the client to
+ * resend (up to OTP_MAX_RETRANSMITS times) while the frame is corrupt
+ * Returns FRAME_CLOSED, FRAME_PLAIN or FRAME_CHECKED
+*******************************************************************************/
+int receiveAcknowledgedMessage(int connectionFD, char clientMessage[], char** payload, char *ack)
+{
+    for (int attempt = 0; attempt <= OTP_MAX_RETRANSMITS; attempt++) {
+        int result = receiveTerminatedClientMessage(connectionFD, clientMessage, payload);
+        if (result != FRAME_CORRUPT) {
+            if (result != FRAME_CLOSED) { sendServerResponse(connectionFD, ack); }
+            return result;
+        }
+
+        countMetric(MC_CHECKSUM_FAILURES, 1);
+        sendServerResponse(connectionFD, OTP_RESEND);
+    }
+
+    fprintf(stderr, "%s: ERROR frame failed its checksum %d times\n", serverName, OTP_MAX_RETRANSMITS + 1);
+    return FRAME_CLOSED;
+}
+
+/******************************************************************************
+ * Takes a socket file descriptor and passed-in message
+ * Sends message to client for either testing OR
+ * When not testing makes client wait before sending next data
+*******************************************************************************/
+void sendServerResponse(int connectionFD, char *message)
+{
+    size_t length = strlen(message);
+    if (otpSendAll(connectionFD, message, length) != OTP_OK) error("ERROR writing to socket");
+    countMetric(MC_BYTES_OUT, (unsigned long long)length);
+}
+
+/******************************************************************************
+ * Send passed-in message followed by terminator characters
+ * (used to check entire message read) to client over passed-in socket
+ * The terminator is gathered into the same write, so the message is not copied
+*******************************************************************************/
+void sendWithTerminator(int socketFD, char *message)
+{
+    size_t length = strlen(message);
+    if (otpSendFrame(socketFD, NULL, 0, message, length) != OTP_OK) error("ERROR writing to socket");
+    countMetric(MC_BYTES_OUT, (unsigned long long)(length + strlen(TERMINATOR)));
+}
+
+/******************************************************************************
+ * Send passed-in message of length chars as a checked frame: a header
+ * declaring its length and CRC32C, then the message and terminator
+*******************************************************************************/
+void sendChecked(int socketFD, char *message, size_t length, uint32_t checksum)
+{
+    char header[OTP_FRAME_HEADER_SIZE + 1];
+
+    otpFormatFrameHeader(header, length, checksum);
+    if (otpSendFrame(socketFD, header, OTP_FRAME_HEADER_SIZE, message, length) != OTP_OK) error("ERROR writing to socket");
+    countMetric(MC_BYTES_OUT, (unsigned long long)(OTP_FRAME_HEADER_SIZE + length + strlen(TERMINATOR)));
+}
@@ -0,0 +1,37 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the server-side functions shared by otp_enc_d,
+ * otp_dec_d and otp_d, which differ only in the programID they accept
+*******************************************************************************/
+
+#ifndef OTP_SERVER_H
+#define OTP_SERVER_H
+
+#include "otp_helpers.h"
+
+#define SERVE_ANY_MODE '*'             // programID of a daemon serving both modes
+
+// Outcome of receiving one frame from a client
+enum frameResult {
+    FRAME_CLOSED,                       // client closed the connection or a read failed
+    FRAME_PLAIN,                        // unchecked frame, as sent by older clients
+    FRAME_CHECKED,                      // checked frame whose length and CRC32C matched
+    FRAME_CORRUPT,                      // checked frame that failed verification
+    FRAME_INCOMPLETE                    // more chars are needed (parseClientFrame only)
+};
+
+extern const char* serverName;
+extern char* statsSocketPath;
+
+int parseServerArgs(int argc, char *argv[]);
+void beginListening(int portNumber);
+char acceptedMode(char clientID);
+char checkClientConnection(int socketFD);
+int parseClientFrame(char* buffer, size_t searchFrom, char** payload, size_t* frameLength);
+int receiveTerminatedClientMessage(int connectionFD, char clientMessage[], char** payload);
+int receiveAcknowledgedMessage(int connectionFD, char clientMessage[], char** payload, char *ack);
+void sendServerResponse(int connectionFD, char *message);
+void sendWithTerminator(int socketFD, char *message);
+void sendChecked(int socketFD, char *message, size_t length, uint32_t checksum);
+
+#endif //OTP_SERVER_H
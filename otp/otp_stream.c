@@ -0,0 +1,215 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the streaming mode of otp_enc and otp_dec
+ *   message and/or key are read from stdin ("-") or a FIFO
+ *   input is cut into chunks sent over a small connection pool
+ *   results are written to stdout in order as each chunk returns
+ * Memory stays bounded by STREAM_WINDOW chunks however long the input is
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "otp_client.h"
+#include "otp_timing.h"
+
+#define STREAM_CHUNK_SIZE 65536
+#define STREAM_WINDOW 4                 // Chunks in flight, one pooled connection each
+
+struct streamChunk {
+    char text[STREAM_CHUNK_SIZE];       // Raw input, newlines included
+    size_t textLength;
+    char symbols[STREAM_CHUNK_SIZE];    // Input with newlines removed
+    char key[STREAM_CHUNK_SIZE];
+    char output[STREAM_CHUNK_SIZE + 1];
+    size_t numSymbols;
+    struct otpFuture* future;
+};
+
+struct keyStream {
+    int fd;
+    const char* path;                   // For error messages
+    char buffer[STREAM_CHUNK_SIZE];
+    size_t position;
+    size_t length;
+};
+
+/******************************************************************************
+ * Returns whether passed-in argument names stdin ("-") or a FIFO,
+ * either of which must be streamed rather than read whole
+*******************************************************************************/
+bool isStreamArgument(const char *path)
+{
+    struct stat fileInfo;
+
+    if (strcmp(path, "-") == 0) { return true; }
+    return stat(path, &fileInfo) == 0 && S_ISFIFO(fileInfo.st_mode);
+}
+
+/******************************************************************************
+ * Open passed-in argument for streaming, "-" meaning stdin
+*******************************************************************************/
+static int openStream(const char *path)
+{
+    if (strcmp(path, "-") == 0) { return STDIN_FILENO; }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { fprintf(stderr, "%s: %s\n", path, strerror(errno)); exit(1); }
+    return fd;
+}
+
+/******************************************************************************
+ * Read up to passed-in count key symbols, skipping newlines
+ * Returns the number of symbols read, less than count only at end of key
+ * A read error is reported and exits
+*******************************************************************************/
+static size_t readKeySymbols(struct keyStream *key, char *dest, size_t count)
+{
+    size_t numRead = 0;
+
+    while (numRead < count) {
+        if (key->position == key->length) {
+            ssize_t charsRead = read(key->fd, key->buffer, sizeof(key->buffer));
+            if (charsRead < 0 && errno == EINTR) { continue; }
+            if (charsRead < 0) { fprintf(stderr, "%s: %s\n", key->path, strerror(errno)); exit(1); }
+            if (charsRead == 0) { break; }
+            key->position = 0;
+            key->length = (size_t)charsRead;
+        }
+
+        char symbol = key->buffer[key->position++];
+        if (symbol != '\n') { dest[numRead++] = symbol; }
+    }
+
+    return numRead;
+}
+
+/******************************************************************************
+ * Returns whether more input can be read without blocking
+*******************************************************************************/
+static bool inputReady(int fd)
+{
+    struct pollfd input = { .fd = fd, .events = POLLIN };
+    return poll(&input, 1, 0) > 0;
+}
+
+/******************************************************************************
+ * Wait for passed-in chunk's transform, then write it to stdout
+ * with the newlines of the input put back where they were
+*******************************************************************************/
+static void writeChunk(struct streamChunk *chunk)
+{
+    if (chunk->future) {
+        int status = otpFutureWait(chunk->future);
+        chunk->future = NULL;
+        if (status != OTP_OK) {
+            if (status == OTP_ERR_BAD_CHARS) {
+                fprintf(stderr, "%s error: input contains bad characters\n", clientName);
+            }
+            else {
+                fprintf(stderr, "%s: ERROR %s\n", clientName, otpStatusString(status));
+            }
+            exit(1);
+        }
+    }
+
+    // Reuse the input buffer for output, replacing every non-newline in order
+    size_t nextSymbol = 0;
+    for (size_t i = 0; i < chunk->textLength; i++) {
+        if (chunk->text[i] != '\n') { chunk->text[i] = chunk->output[nextSymbol++]; }
+    }
+
+    fwrite(chunk->text, 1, chunk->textLength, stdout);
+    fflush(stdout);
+}
+
+/******************************************************************************
+ * Stream message from messageFile through the daemon on passed-in port,
+ * consuming key symbols from keyFile one for one, newlines excepted
+ * Output is progressive: each chunk is printed as soon as it and all
+ * earlier chunks have returned
+*******************************************************************************/
+void streamConnection(int portNumber, char *messageFile, char *keyFile)
+{
+    struct otpPool* pool = NULL;
+    struct keyStream key = { .position = 0, .length = 0 };
+    size_t totalSymbols = 0;
+    int head = 0, inFlight = 0;
+    bool endOfInput = false;
+
+    if (strcmp(messageFile, "-") == 0 && strcmp(keyFile, "-") == 0) {
+        fprintf(stderr, "%s: message and key cannot both be read from stdin\n", clientName);
+        exit(1);
+    }
+
+    int messageFD = openStream(messageFile);
+    key.fd = openStream(keyFile);
+    key.path = keyFile;
+
+    // Connect and check connected to the matching daemon ONLY
+    int status = otpPoolCreate("localhost", portNumber, programID, STREAM_WINDOW, &pool);
+    if (status == OTP_ERR_HANDSHAKE) {
+        fprintf(stderr, "Error: could not contact %s on port %d\n", daemonName, portNumber);
+        exit(2);
+    }
+    if (status != OTP_OK) {
+        fprintf(stderr, "%s: ERROR connecting to %s: %s\n", clientName, daemonName, otpStatusString(status));
+        exit(0);
+    }
+    markStage(STAGE_CONNECT);
+
+    struct streamChunk* chunks = calloc(STREAM_WINDOW, sizeof(struct streamChunk));
+    if (!chunks) { error("calloc"); }
+
+    while (!endOfInput || inFlight > 0) {
+
+        // Print finished chunks first if reading would block or the window is full
+        if (inFlight > 0 && (endOfInput || inFlight == STREAM_WINDOW || !inputReady(messageFD))) {
+            writeChunk(&chunks[head]);
+            head = (head + 1) % STREAM_WINDOW;
+            inFlight--;
+            continue;
+        }
+
+        // Read whatever input is available into the next free chunk
+        struct streamChunk* chunk = &chunks[(head + inFlight) % STREAM_WINDOW];
+        ssize_t charsRead = read(messageFD, chunk->text, sizeof(chunk->text));
+        if (charsRead < 0 && errno == EINTR) { continue; }
+        if (charsRead < 0) { fprintf(stderr, "%s: %s\n", messageFile, strerror(errno)); exit(1); }
+        if (charsRead == 0) { endOfInput = true; continue; }
+        chunk->textLength = (size_t)charsRead;
+
+        // Drop newlines; they pass through untransformed and use no key
+        chunk->numSymbols = 0;
+        for (size_t i = 0; i < chunk->textLength; i++) {
+            if (chunk->text[i] != '\n') { chunk->symbols[chunk->numSymbols++] = chunk->text[i]; }
+        }
+
+        if (readKeySymbols(&key, chunk->key, chunk->numSymbols) < chunk->numSymbols) {
+            fprintf(stderr, "Error: key '%s' is too short\n", keyFile);
+            exit(1);
+        }
+        totalSymbols += chunk->numSymbols;
+
+        chunk->future = NULL;
+        if (chunk->numSymbols > 0) {
+            chunk->future = otpPoolSubmitFuture(pool, chunk->key, chunk->numSymbols,
+                                                chunk->symbols, chunk->numSymbols,
+                                                chunk->output, sizeof(chunk->output));
+            if (!chunk->future) { error("otpPoolSubmitFuture"); }
+        }
+        inFlight++;
+    }
+    markStage(STAGE_RECEIVE);
+
+    otpPoolDestroy(pool);
+    free(chunks);
+    if (messageFD != STDIN_FILENO) { close(messageFD); }
+    if (key.fd != STDIN_FILENO) { close(key.fd); }
+
+    reportTiming(clientName, totalSymbols);
+}
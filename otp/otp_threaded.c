@@ -0,0 +1,640 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the threaded mode of the otp daemons
+ * Each connection belongs to one I/O thread and is only ever touched by it,
+ * except while its transform runs on the executor; it is then disarmed in
+ * epoll (every registration is one-shot) until the executor posts it back
+ * through its I/O thread's inbox, so it needs no lock of its own
+ * The key frame stays in the input buffer while the message frame is
+ * read after it, and both are transformed in place
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "otp_threaded.h"
+#include "otp_server.h"
+#include "otp_executor.h"
+#include "otp_metrics.h"
+#include "otp_sched.h"
+#include "otp_keyindex.h"
+#include "otp_trace.h"
+
+#define INITIAL_INPUT_SIZE 16384
+#define MAX_INPUT_SIZE (2 * BUFFER_SIZE)     // A key frame and a message frame
+#define PENDING_SIZE 128                // Acks and a reply header
+#define EPOLL_BATCH 64
+#define DRAIN_POLL_MS 100
+#define DRAIN_TIMEOUT_SECONDS 30
+
+enum connectionStage {
+    CONN_HANDSHAKE,
+    CONN_KEY,
+    CONN_MESSAGE,
+    CONN_TRANSFORM                      // Owned by the executor until posted back
+};
+
+struct ioThread;
+
+struct threadedConnection {
+    int fd;
+    uint32_t address;
+    uint64_t traceConnection;
+    struct ioThread* owner;
+    struct threadedConnection* prev;    // In the owner's list
+    struct threadedConnection* next;
+    struct threadedConnection* nextInbox;
+    bool registered;                    // Added to the owner's epoll set
+    bool abandoned;                     // Closed while its transform ran
+    bool closeAfterWrite;
+    int stage;
+    char mode;
+
+    char* input;                        // Null-terminated at inputLength
+    size_t inputLength;
+    size_t inputCapacity;
+    size_t frameStart;                  // Frame being received; earlier ones are this request's
+    size_t searchFrom;                  // Chars of it already searched for a terminator
+    int corruptFrames;                  // Resends asked for in a row
+    int keyFrame;
+    size_t keyOffset;
+    size_t messageOffset;
+    size_t length;
+
+    char pending[PENDING_SIZE];         // Sent first, then the reply
+    size_t pendingLength;
+    char* reply;                        // Transformed message and terminator
+    size_t replyLength;
+    size_t replySent;
+
+    // Set by whichever thread transforms
+    int status;
+    bool keyRejected;
+    uint32_t checksum;
+    unsigned long long requestStart;
+    unsigned long long queuedAt;
+};
+
+struct ioThread {
+    pthread_t thread;
+    int epollFD;
+    int wakeFD;                         // eventfd: inbox has connections
+    int metricsSlot;
+    pthread_mutex_t inboxLock;
+    struct threadedConnection* inbox;   // New connections and finished transforms
+    struct threadedConnection* connections;
+};
+
+bool threadedMode = false;
+
+static struct ioThread ioThreads[MAX_IO_THREADS];
+static int numIOThreads = 0;
+static unsigned int nextIOThread = 0;
+static int openConnections = 0;
+static bool draining = false;
+
+/*******************************************************************************
+ * Post passed-in connection to its I/O thread's inbox and wake the thread
+*******************************************************************************/
+static void postToIOThread(struct threadedConnection* conn)
+{
+    struct ioThread* io = conn->owner;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&io->inboxLock);
+    conn->nextInbox = io->inbox;
+    io->inbox = conn;
+    pthread_mutex_unlock(&io->inboxLock);
+
+    if (write(io->wakeFD, &one, sizeof(one)) < 0) { perror("eventfd"); }
+}
+
+/*******************************************************************************
+ * Add passed-in text to what is sent before any reply
+ * Returns false if it does not fit, which no well-behaved client causes
+*******************************************************************************/
+static bool queueOutput(struct threadedConnection* conn, const char* text, size_t length)
+{
+    if (conn->pendingLength + length > PENDING_SIZE) { return false; }
+    memcpy(conn->pending + conn->pendingLength, text, length);
+    conn->pendingLength += length;
+    return true;
+}
+
+static bool outputPending(struct threadedConnection* conn)
+{
+    return conn->pendingLength > 0 || conn->replySent < conn->replyLength;
+}
+
+/*******************************************************************************
+ * Returns whether passed-in connection may take in its next request: not
+ * while its transform runs, nor until its reply has been sent, so acks
+ * never overtake the reply and the reply buffer is never reused early
+*******************************************************************************/
+static bool acceptsInput(struct threadedConnection* conn)
+{
+    return conn->stage != CONN_TRANSFORM && conn->reply == NULL;
+}
+
+/*******************************************************************************
+ * Send as much pending output as the socket takes without blocking
+ * Returns false if the connection failed
+*******************************************************************************/
+static bool flushOutput(struct threadedConnection* conn)
+{
+    while (outputPending(conn)) {
+        struct iovec parts[2];
+        struct msghdr message = {0};
+
+        message.msg_iov = parts;
+        if (conn->pendingLength > 0) {
+            parts[message.msg_iovlen++] = (struct iovec){ conn->pending, conn->pendingLength };
+        }
+        if (conn->replySent < conn->replyLength) {
+            parts[message.msg_iovlen++] = (struct iovec){ conn->reply + conn->replySent, conn->replyLength - conn->replySent };
+        }
+
+        ssize_t charsSent = sendmsg(conn->fd, &message, MSG_NOSIGNAL);
+        if (charsSent < 0 && errno == EINTR) { continue; }
+        if (charsSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return true; }
+        if (charsSent < 0) { return false; }
+        countMetric(MC_BYTES_OUT, (unsigned long long)charsSent);
+
+        size_t fromPending = (size_t)charsSent < conn->pendingLength ? (size_t)charsSent : conn->pendingLength;
+        memmove(conn->pending, conn->pending + fromPending, conn->pendingLength - fromPending);
+        conn->pendingLength -= fromPending;
+        conn->replySent += (size_t)charsSent - fromPending;
+    }
+
+    // The reply buffer is the executor's until finishTransform sets replyLength
+    if (conn->replyLength > 0) {
+        free(conn->reply);
+        conn->reply = NULL;
+        conn->replyLength = conn->replySent = 0;
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Read whatever has arrived without blocking, growing the input buffer
+ * Returns false if the client closed the connection or it failed
+*******************************************************************************/
+static bool readInput(struct threadedConnection* conn)
+{
+    while (1) {
+        if (conn->inputLength + 1 == conn->inputCapacity) {
+            if (conn->inputCapacity >= MAX_INPUT_SIZE) { return true; }     // processInput reports it
+            char* input = realloc(conn->input, conn->inputCapacity * 2);
+            if (!input) { error("realloc"); }
+            conn->input = input;
+            conn->inputCapacity *= 2;
+        }
+
+        ssize_t charsRead = recv(conn->fd, conn->input + conn->inputLength,
+                                 conn->inputCapacity - 1 - conn->inputLength, 0);
+        if (charsRead == 0) { return false; }
+        if (charsRead < 0 && errno == EINTR) { continue; }
+        if (charsRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return true; }
+        if (charsRead < 0) {
+            fprintf(stderr, "%s: ERROR reading from socket\n", serverName);
+            return false;
+        }
+
+        conn->inputLength += (size_t)charsRead;
+        conn->input[conn->inputLength] = '\0';
+        countMetric(MC_BYTES_IN, (unsigned long long)charsRead);
+    }
+}
+
+/*******************************************************************************
+ * Transform the request held by passed-in connection, on whichever thread
+*******************************************************************************/
+static void transformRequest(struct threadedConnection* conn)
+{
+    char* key = conn->input + conn->keyOffset;
+    char* message = conn->input + conn->messageOffset;
+    unsigned long long transformStart = monotonicNanos();
+
+    conn->reply = malloc(conn->length + strlen(TERMINATOR) + 1);
+    if (!conn->reply) { error("malloc"); }
+
+    conn->status = conn->keyFrame == FRAME_CHECKED
+        ? otpTransformChecksum(conn->mode, key, strlen(key), message, conn->length, conn->reply, conn->length + 1, &conn->checksum)
+        : otpTransform(conn->mode, key, strlen(key), message, conn->length, conn->reply, conn->length + 1);
+    if (conn->status != OTP_OK) { return; }
+
+    unsigned long long transformNanos = monotonicNanos() - transformStart;
+    countMetric(MC_TRANSFORMS, 1);
+    countMetric(conn->mode == OTP_ENCRYPT ? MC_ENCRYPTS : MC_DECRYPTS, 1);
+    countMetric(MC_TRANSFORM_NS, transformNanos);
+    recordLatency(MH_TRANSFORM_US, transformNanos);
+
+    // A key already used with another message is flagged, or refused
+    if (indexKeyWindows(conn->mode, key, message, conn->length) > 0) {
+        countMetric(MC_KEY_REUSE, 1);
+        conn->keyRejected = keyReusePolicy == KEY_REUSE_REJECT;
+    }
+}
+
+/*******************************************************************************
+ * Executor task: transform, then hand the connection back to its I/O thread
+*******************************************************************************/
+static void runQueuedTransform(void* arg)
+{
+    struct threadedConnection* conn = arg;
+
+    recordLatency(MH_QUEUE_US, monotonicNanos() - conn->queuedAt);
+    transformRequest(conn);
+    postToIOThread(conn);
+}
+
+/*******************************************************************************
+ * Queue the reply to a transformed request and make ready for the next one
+ * Returns false if the request failed and the connection should close
+*******************************************************************************/
+static bool finishTransform(struct threadedConnection* conn)
+{
+    if (conn->status != OTP_OK || conn->keyRejected) {
+        fprintf(stderr, "%s: ERROR %s\n", serverName,
+                conn->keyRejected ? "key reused with a different message" : otpStatusString(conn->status));
+        return false;
+    }
+
+    // Reply in the same framing the client used
+    if (conn->keyFrame == FRAME_CHECKED) {
+        char header[OTP_FRAME_HEADER_SIZE + 1];
+        otpFormatFrameHeader(header, conn->length, conn->checksum);
+        if (!queueOutput(conn, header, OTP_FRAME_HEADER_SIZE)) { return false; }
+    }
+    memcpy(conn->reply + conn->length, TERMINATOR, strlen(TERMINATOR));
+    conn->replyLength = conn->length + strlen(TERMINATOR);
+    conn->replySent = 0;
+
+    recordLatency(MH_REQUEST_US, monotonicNanos() - conn->requestStart);
+    recordTrace(conn->traceConnection, conn->mode, conn->keyFrame == FRAME_CHECKED, conn->requestStart,
+                conn->input + conn->keyOffset, strlen(conn->input + conn->keyOffset),
+                conn->input + conn->messageOffset, conn->length);
+
+    // Drop this request's frames, keeping anything sent after them
+    conn->inputLength -= conn->frameStart;
+    memmove(conn->input, conn->input + conn->frameStart, conn->inputLength + 1);
+    conn->frameStart = conn->searchFrom = 0;
+    conn->stage = CONN_KEY;
+    return true;
+}
+
+/*******************************************************************************
+ * Transform a fast-lane sized request at once on the I/O thread, or
+ * queue it on the executor
+ * Returns false if the connection should close
+*******************************************************************************/
+static bool startTransform(struct threadedConnection* conn)
+{
+    conn->length = strlen(conn->input + conn->messageOffset);
+    conn->keyRejected = false;
+    conn->stage = CONN_TRANSFORM;
+
+    if (schedConfig.fastLaneTurns > 0 && conn->length <= schedConfig.fastLaneBytes) {
+        countMetric(MC_FAST_LANE, 1);
+        transformRequest(conn);
+        return finishTransform(conn);
+    }
+
+    countMetric(MC_QUEUED, 1);
+    conn->queuedAt = monotonicNanos();
+    submitTask(runQueuedTransform, conn);
+    return true;
+}
+
+/*******************************************************************************
+ * Act on every whole handshake or frame that has arrived
+ * Returns false if the connection should close
+*******************************************************************************/
+static bool processInput(struct threadedConnection* conn)
+{
+    if (conn->stage == CONN_HANDSHAKE && conn->inputLength > 0) {
+        conn->mode = acceptedMode(conn->input[0]);
+        conn->inputLength--;
+        memmove(conn->input, conn->input + 1, conn->inputLength + 1);
+
+        if (!conn->mode) {
+            countMetric(MC_CONN_REJECTED, 1);
+            conn->closeAfterWrite = true;
+            return queueOutput(conn, "F", 1);                           // Failed connection
+        }
+        conn->stage = CONN_KEY;
+        if (!queueOutput(conn, "S", 1)) { return false; }               // Successful connection
+    }
+
+    while (conn->stage != CONN_TRANSFORM && conn->inputLength > conn->frameStart) {
+        // Requests sent ahead wait until the last reply has gone out
+        if (conn->reply && !flushOutput(conn)) { return false; }
+        if (!acceptsInput(conn)) { return true; }
+
+        char* frame = conn->input + conn->frameStart;
+        size_t available = conn->inputLength - conn->frameStart;
+        size_t frameLength = 0;
+        char* payload = NULL;
+
+        int result = parseClientFrame(frame, conn->searchFrom, &payload, &frameLength);
+        if (result == FRAME_INCOMPLETE) {
+            if (available >= BUFFER_SIZE - 1) {
+                fprintf(stderr, "%s: ERROR message too long\n", serverName);
+                return false;
+            }
+            conn->searchFrom = available - 1;                           // In case "@@" was split
+            return true;
+        }
+        conn->searchFrom = 0;
+
+        // Ask for a corrupt frame again, dropping it through its terminator
+        // (never by its declared length, which may be what is corrupt)
+        if (result == FRAME_CORRUPT) {
+            countMetric(MC_CHECKSUM_FAILURES, 1);
+            if (++conn->corruptFrames > OTP_MAX_RETRANSMITS) {
+                fprintf(stderr, "%s: ERROR frame failed its checksum %d times\n", serverName, OTP_MAX_RETRANSMITS + 1);
+                return false;
+            }
+            conn->inputLength -= frameLength;
+            memmove(frame, frame + frameLength, conn->inputLength - conn->frameStart + 1);
+            if (!queueOutput(conn, OTP_RESEND, strlen(OTP_RESEND))) { return false; }
+            continue;
+        }
+        conn->corruptFrames = 0;
+        conn->frameStart += frameLength;
+
+        if (conn->stage == CONN_KEY) {
+            conn->requestStart = monotonicNanos();
+            conn->keyFrame = result;
+            conn->keyOffset = (size_t)(payload - conn->input);
+            conn->stage = CONN_MESSAGE;
+            if (!queueOutput(conn, OTP_KEY_ACK, strlen(OTP_KEY_ACK))) { return false; }
+        }
+        else {
+            conn->messageOffset = (size_t)(payload - conn->input);
+            if (!queueOutput(conn, OTP_MESSAGE_ACK, strlen(OTP_MESSAGE_ACK))) { return false; }
+            if (!flushOutput(conn)) { return false; }                   // Ack before a long transform
+            if (!startTransform(conn)) { return false; }
+        }
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Returns whether passed-in connection is between requests with nothing
+ * to send, so a draining daemon may close it
+*******************************************************************************/
+static bool isIdle(struct threadedConnection* conn)
+{
+    return conn->stage == CONN_KEY && conn->inputLength == 0 && !outputPending(conn);
+}
+
+/*******************************************************************************
+ * Close passed-in connection, unless its transform is running, in which
+ * case it is closed when posted back
+*******************************************************************************/
+static void closeConnection(struct threadedConnection* conn)
+{
+    if (conn->stage == CONN_TRANSFORM) {
+        conn->abandoned = true;
+        return;
+    }
+
+    if (conn->stage == CONN_HANDSHAKE) { countMetric(MC_HANDSHAKE_FAILURES, 1); }
+
+    struct ioThread* io = conn->owner;
+    if (conn->prev) { conn->prev->next = conn->next; }
+    else { io->connections = conn->next; }
+    if (conn->next) { conn->next->prev = conn->prev; }
+
+    close(conn->fd);
+    free(conn->input);
+    free(conn->reply);
+    free(conn);
+    __atomic_fetch_sub(&openConnections, 1, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * Re-arm passed-in connection for the event it waits for next:
+ * writable while output is pending, else readable, else (while its
+ * transform runs) nothing
+*******************************************************************************/
+static bool armConnection(struct threadedConnection* conn)
+{
+    struct epoll_event event = {0};
+
+    if (outputPending(conn)) { event.events = EPOLLOUT; }
+    else if (conn->stage != CONN_TRANSFORM) { event.events = EPOLLIN; }
+    else { return true; }
+
+    event.events |= EPOLLONESHOT;
+    event.data.ptr = conn;
+    return epoll_ctl(conn->owner->epollFD, EPOLL_CTL_MOD, conn->fd, &event) == 0;
+}
+
+/*******************************************************************************
+ * Handle passed-in epoll events on a connection, or its transform having
+ * finished, then wait for what it needs next or close it
+*******************************************************************************/
+static void serviceConnection(struct threadedConnection* conn, uint32_t events, bool transformed)
+{
+    bool open = true;
+
+    if (transformed) {
+        conn->stage = CONN_KEY;                                         // Back from the executor
+        open = !conn->abandoned && finishTransform(conn);
+    }
+
+    // Input is transformed in place, so none is read while a transform runs
+    // or its reply is sent
+    if (open && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && acceptsInput(conn)) {
+        open = readInput(conn);
+    }
+    if (open) { open = processInput(conn) && flushOutput(conn); }
+    if (open && conn->closeAfterWrite && !outputPending(conn)) { open = false; }
+    if (open && __atomic_load_n(&draining, __ATOMIC_ACQUIRE) && isIdle(conn)) { open = false; }
+    if (open) { open = armConnection(conn); }
+
+    if (!open) { closeConnection(conn); }
+}
+
+/*******************************************************************************
+ * Take a connection new to this I/O thread into its epoll set
+*******************************************************************************/
+static void registerConnection(struct ioThread* io, struct threadedConnection* conn)
+{
+    struct epoll_event event = {0};
+
+    conn->registered = true;
+    conn->next = io->connections;
+    if (io->connections) { io->connections->prev = conn; }
+    io->connections = conn;
+
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = conn;
+    if (epoll_ctl(io->epollFD, EPOLL_CTL_ADD, conn->fd, &event) < 0) {
+        perror("epoll_ctl");
+        closeConnection(conn);
+    }
+}
+
+/*******************************************************************************
+ * Handle everything posted to passed-in I/O thread's inbox
+*******************************************************************************/
+static void drainInbox(struct ioThread* io)
+{
+    uint64_t count;
+
+    if (read(io->wakeFD, &count, sizeof(count)) < 0 && errno != EAGAIN) { perror("eventfd"); }
+
+    pthread_mutex_lock(&io->inboxLock);
+    struct threadedConnection* conn = io->inbox;
+    io->inbox = NULL;
+    pthread_mutex_unlock(&io->inboxLock);
+
+    while (conn) {
+        struct threadedConnection* next = conn->nextInbox;
+        if (!conn->registered) { registerConnection(io, conn); }
+        else { serviceConnection(conn, 0, true); }
+        conn = next;
+    }
+}
+
+/*******************************************************************************
+ * I/O thread: wait for socket events and posted connections
+ * While draining, idle connections are closed as they are found
+*******************************************************************************/
+static void* runIOThread(void* arg)
+{
+    struct ioThread* io = arg;
+    struct epoll_event events[EPOLL_BATCH];
+
+    claimMetricsSlot(io->metricsSlot);
+
+    while (1) {
+        bool isDraining = __atomic_load_n(&draining, __ATOMIC_ACQUIRE);
+        int numEvents = epoll_wait(io->epollFD, events, EPOLL_BATCH, isDraining ? DRAIN_POLL_MS : -1);
+        if (numEvents < 0 && errno != EINTR) { error("epoll_wait"); }
+
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.ptr == NULL) { drainInbox(io); }
+            else { serviceConnection(events[i].data.ptr, events[i].events, false); }
+        }
+
+        if (isDraining) {
+            struct threadedConnection* conn = io->connections;
+            while (conn) {
+                struct threadedConnection* next = conn->next;
+                if (isIdle(conn)) { closeConnection(conn); }
+                conn = next;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ * Start the transform executor and the I/O threads
+ * Transform threads: -c, or one per CPU; I/O threads: one per
+ * TRANSFORMS_PER_IO_THREAD of them, up to MAX_IO_THREADS
+ * Signals stay with the accept loop, which acts on them
+*******************************************************************************/
+void startThreadedServer()
+{
+    int numTransformThreads = schedConfig.maxConcurrent > 0 ? schedConfig.maxConcurrent
+                                                            : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    sigset_t allSignals, previousMask;
+
+    numIOThreads = numTransformThreads / TRANSFORMS_PER_IO_THREAD;
+    if (numIOThreads < 1) { numIOThreads = 1; }
+    if (numIOThreads > MAX_IO_THREADS) { numIOThreads = MAX_IO_THREADS; }
+
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previousMask);             // Inherited by every thread
+
+    startExecutor(numTransformThreads, 1 + numIOThreads);               // Slot 0 is the accept loop's
+
+    for (int t = 0; t < numIOThreads; t++) {
+        struct ioThread* io = &ioThreads[t];
+        struct epoll_event wakeEvent = {0};
+
+        io->metricsSlot = 1 + t;
+        pthread_mutex_init(&io->inboxLock, NULL);
+        io->epollFD = epoll_create1(EPOLL_CLOEXEC);
+        io->wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (io->epollFD < 0 || io->wakeFD < 0) { error("epoll"); }
+
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = NULL;
+        if (epoll_ctl(io->epollFD, EPOLL_CTL_ADD, io->wakeFD, &wakeEvent) < 0) { error("epoll_ctl"); }
+        if (pthread_create(&io->thread, NULL, runIOThread, io) != 0) { error("pthread_create"); }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+}
+
+/*******************************************************************************
+ * Give passed-in accepted connection, traced as traceConnection, to the
+ * next I/O thread round-robin
+*******************************************************************************/
+void handThreadedConnection(int connectionFD, uint32_t address, uint64_t traceConnection)
+{
+    struct threadedConnection* conn = calloc(1, sizeof(struct threadedConnection));
+    if (!conn) { error("calloc"); }
+
+    fcntl(connectionFD, F_SETFL, fcntl(connectionFD, F_GETFL) | O_NONBLOCK);
+    fcntl(connectionFD, F_SETFD, FD_CLOEXEC);
+
+    conn->fd = connectionFD;
+    conn->address = address;
+    conn->traceConnection = traceConnection;
+    conn->owner = &ioThreads[nextIOThread++ % (unsigned int)numIOThreads];
+    conn->stage = CONN_HANDSHAKE;
+    conn->inputCapacity = INITIAL_INPUT_SIZE;
+    conn->input = malloc(conn->inputCapacity);
+    if (!conn->input) { error("malloc"); }
+    conn->input[0] = '\0';
+
+    __atomic_fetch_add(&openConnections, 1, __ATOMIC_RELAXED);
+    postToIOThread(conn);
+}
+
+/*******************************************************************************
+ * Stop accepting, let every connection finish its current request, then exit
+ * Connections idle between requests are closed at once; pooled clients
+ * reconnect, reaching the new daemon
+*******************************************************************************/
+void drainThreadedAndExit(int listenSocketFD)
+{
+    uint64_t one = 1;
+
+    close(listenSocketFD);
+    __atomic_store_n(&draining, true, __ATOMIC_RELEASE);
+    for (int t = 0; t < numIOThreads; t++) {
+        if (write(ioThreads[t].wakeFD, &one, sizeof(one)) < 0) { perror("eventfd"); }
+    }
+
+    unsigned long long deadline = monotonicNanos() + DRAIN_TIMEOUT_SECONDS * 1000000000ULL;
+    while (__atomic_load_n(&openConnections, __ATOMIC_ACQUIRE) > 0) {
+        if (monotonicNanos() > deadline) {
+            fprintf(stderr, "%s: %d connections still busy after %ds, exiting\n",
+                    serverName, __atomic_load_n(&openConnections, __ATOMIC_ACQUIRE), DRAIN_TIMEOUT_SECONDS);
+            break;
+        }
+
+        struct timespec pause = { 0, 50000000L };
+        nanosleep(&pause, NULL);
+    }
+
+    exit(0);
+}
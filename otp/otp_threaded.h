@@ -0,0 +1,28 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the threaded mode of the otp daemons (-T), an
+ * alternative to a forked worker per connection:
+ *   the accept loop hands each connection to one of a few I/O threads
+ *   I/O threads multiplex their connections with epoll, reading frames
+ *   and writing acks and replies without blocking
+ *   transforms run on the work-stealing executor (otp_executor.h), and
+ *   fast-lane sized ones inline on the I/O thread, so a burst of large
+ *   transforms never holds up accepts, acks or small replies
+*******************************************************************************/
+
+#ifndef OTP_THREADED_H
+#define OTP_THREADED_H
+
+#include <stdint.h>
+#include "otp_helpers.h"
+
+#define MAX_IO_THREADS 4
+#define TRANSFORMS_PER_IO_THREAD 4      // One I/O thread per this many transform threads
+
+extern bool threadedMode;
+
+void startThreadedServer();
+void handThreadedConnection(int connectionFD, uint32_t address, uint64_t traceConnection);
+void drainThreadedAndExit(int listenSocketFD);
+
+#endif //OTP_THREADED_H
@@ -0,0 +1,88 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file defines the opt-in per-stage timing used by otp_enc/otp_dec
+ * Each stage's duration is the time since the previous mark, so stages
+ * add up to the total and the slow one stands out
+*******************************************************************************/
+
+#include <stdio.h>
+#include <unistd.h>
+#include "otp_timing.h"
+
+bool timingEnabled = false;
+bool timingToStderr = false;
+char* timingJSONPath = NULL;
+
+static unsigned long long startNanos = 0;
+static unsigned long long lastMarkNanos = 0;
+static unsigned long long stageNanos[NUM_CLIENT_STAGES];
+
+static const char* stageNames[NUM_CLIENT_STAGES] = {
+    "read_key", "read_text", "validate", "resolve", "connect", "handshake",
+    "send_key", "key_ack", "send_text", "text_ack", "receive"
+};
+
+/*******************************************************************************
+ * Record the starting timestamp; timing is on if either output is requested
+*******************************************************************************/
+void startTiming()
+{
+    timingEnabled = timingToStderr || timingJSONPath;
+    if (!timingEnabled) { return; }
+
+    startNanos = lastMarkNanos = monotonicNanos();
+    memset(stageNanos, 0, sizeof(stageNanos));
+}
+
+/*******************************************************************************
+ * Charge the time since the previous mark to the passed-in stage
+*******************************************************************************/
+void markStage(enum clientStage stage)
+{
+    if (!timingEnabled) { return; }
+
+    unsigned long long now = monotonicNanos();
+    stageNanos[stage] += now - lastMarkNanos;
+    lastMarkNanos = now;
+}
+
+/*******************************************************************************
+ * Stage hook passed to libotp for the stages of the remote path
+*******************************************************************************/
+void markLibraryStage(enum otpStage stage)
+{
+    markStage((enum clientStage)(STAGE_RESOLVE + stage));
+}
+
+/*******************************************************************************
+ * Print a compact one-line breakdown to stderr if requested
+ * Append the same data as a JSON line if a JSON path was given
+*******************************************************************************/
+void reportTiming(const char* clientName, size_t messageLength)
+{
+    if (!timingEnabled) { return; }
+
+    unsigned long long totalNanos = lastMarkNanos - startNanos;
+
+    // e.g. "otp_enc timing: read_key=12us ... total=840us"
+    if (timingToStderr) {
+        fprintf(stderr, "%s timing:", clientName);
+        for (int s = 0; s < NUM_CLIENT_STAGES; s++) {
+            fprintf(stderr, " %s=%lluus", stageNames[s], stageNanos[s] / 1000);
+        }
+        fprintf(stderr, " total=%lluus\n", totalNanos / 1000);
+    }
+
+    if (timingJSONPath) {
+        FILE* jsonFile = fopen(timingJSONPath, "a");
+        if (!jsonFile) { fprintf(stderr, "%s: %s\n", timingJSONPath, strerror(errno)); return; }
+
+        fprintf(jsonFile, "{\"client\":\"%s\",\"pid\":%d,\"bytes\":%zu", clientName, (int)getpid(), messageLength);
+        for (int s = 0; s < NUM_CLIENT_STAGES; s++) {
+            fprintf(jsonFile, ",\"%s_ns\":%llu", stageNames[s], stageNanos[s]);
+        }
+        fprintf(jsonFile, ",\"total_ns\":%llu}\n", totalNanos);
+
+        fclose(jsonFile);
+    }
+}
@@ -0,0 +1,39 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the opt-in per-stage timing used by otp_enc/otp_dec:
+ *   a monotonic timestamp is taken at the end of each client stage
+ *   the breakdown is printed to stderr and/or appended as a JSON line
+*******************************************************************************/
+
+#ifndef OTP_TIMING_H
+#define OTP_TIMING_H
+
+#include <stdio.h>
+#include "otp_helpers.h"
+
+// Stages from STAGE_RESOLVE on are reported by libotp in otpStage order
+enum clientStage {
+    STAGE_READ_KEY,
+    STAGE_READ_TEXT,
+    STAGE_VALIDATE,
+    STAGE_RESOLVE,
+    STAGE_CONNECT,
+    STAGE_HANDSHAKE,
+    STAGE_SEND_KEY,
+    STAGE_KEY_ACK,
+    STAGE_SEND_TEXT,
+    STAGE_TEXT_ACK,
+    STAGE_RECEIVE,
+    NUM_CLIENT_STAGES
+};
+
+extern bool timingEnabled;
+extern bool timingToStderr;
+extern char* timingJSONPath;
+
+void startTiming();
+void markStage(enum clientStage stage);
+void markLibraryStage(enum otpStage stage);
+void reportTiming(const char* clientName, size_t messageLength);
+
+#endif //OTP_TIMING_H
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Source file for the request trace written by the otp daemons
+ * The trace is opened O_APPEND before any worker is forked, and each
+ * request is one writev of record and payloads, so records from workers
+ * and threads never interleave
+ * Arrival times are taken on the monotonic clock like every other daemon
+ * timing, and shifted onto the wall clock so that a replacement daemon
+ * appending to the same trace stays in order
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "otp_trace.h"
+#include "otp_server.h"
+
+char* tracePath = NULL;
+bool tracePayloads = false;
+
+static int traceFD = -1;
+static unsigned long long wallClockOffset = 0;      // CLOCK_REALTIME minus CLOCK_MONOTONIC
+static bool writeFailed = false;
+
+/*******************************************************************************
+ * Open the trace for appending, starting it with a header if it is new
+ * An existing trace must be one; a restarted daemon carries on with it
+*******************************************************************************/
+void openTrace()
+{
+    struct timespec now;
+    char magic[TRACE_MAGIC_SIZE];
+
+    if (!tracePath) { return; }
+
+    traceFD = open(tracePath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (traceFD < 0) { fprintf(stderr, "%s: %s: %s\n", serverName, tracePath, strerror(errno)); exit(1); }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    unsigned long long wallNanos = (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+    wallClockOffset = wallNanos - monotonicNanos();
+
+    if (lseek(traceFD, 0, SEEK_END) == 0) {
+        struct traceHeader header = {{0}};
+        memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+        header.createdNanos = wallNanos;
+        if (write(traceFD, &header, sizeof(header)) != sizeof(header)) { error("trace: ERROR writing header"); }
+    }
+    else if (pread(traceFD, magic, TRACE_MAGIC_SIZE, 0) != TRACE_MAGIC_SIZE ||
+             memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "%s: %s is not a request trace\n", serverName, tracePath);
+        exit(1);
+    }
+}
+
+/*******************************************************************************
+ * Returns an ID for passed-in connection number, unique across restarts
+*******************************************************************************/
+uint64_t traceConnectionID(uint32_t connectionNumber)
+{
+    return (uint64_t)getpid() << 32 | connectionNumber;
+}
+
+/*******************************************************************************
+ * Append one request to the trace, with its payloads if -D was given
+ * requestStart is the monotonic time its key frame arrived
+ * A failed write is reported once; the daemon keeps serving regardless
+*******************************************************************************/
+void recordTrace(uint64_t connection, char mode, bool checked, unsigned long long requestStart,
+                 const char* key, size_t keyLength, const char* message, size_t messageLength)
+{
+    struct traceRecord record = {0};
+    struct iovec parts[3];
+    int numParts = 1;
+
+    if (traceFD < 0) { return; }
+
+    record.arrivalNanos = requestStart + wallClockOffset;
+    record.connection = connection;
+    record.keyLength = (uint32_t)keyLength;
+    record.messageLength = (uint32_t)messageLength;
+    record.mode = (uint8_t)mode;
+    record.flags = (checked ? TRACE_CHECKED : 0) | (tracePayloads ? TRACE_PAYLOADS : 0);
+
+    parts[0] = (struct iovec){ &record, sizeof(record) };
+    if (tracePayloads) {
+        parts[numParts++] = (struct iovec){ (void*)key, keyLength };
+        parts[numParts++] = (struct iovec){ (void*)message, messageLength };
+    }
+
+    ssize_t expected = (ssize_t)(sizeof(record) + (tracePayloads ? keyLength + messageLength : 0));
+    if (writev(traceFD, parts, numParts) != expected && !writeFailed) {
+        writeFailed = true;
+        fprintf(stderr, "%s: ERROR writing trace %s\n", serverName, tracePath);
+    }
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+ * OTP - a One-Time Pad encryption program
+ * Header file declares the request trace written by the otp daemons (-R)
+ * and read back by otp_replay:
+ *   a header, then one fixed-size record per request: when its key frame
+ *   arrived, which connection it came on, its mode, framing and sizes
+ *   optionally (-D) followed by the key and message themselves
+ *   records are appended whole by every worker, so one trace covers the
+ *   daemon and, across a restart, the daemon that replaces it
+*******************************************************************************/
+
+#ifndef OTP_TRACE_H
+#define OTP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_helpers.h"
+
+#define TRACE_MAGIC "OTPTRC1\n"
+#define TRACE_MAGIC_SIZE 8
+
+// Record flags
+#define TRACE_CHECKED 1                 // Client sent checked frames
+#define TRACE_PAYLOADS 2                // Key and message follow the record
+
+struct traceHeader {
+    char magic[TRACE_MAGIC_SIZE];
+    uint64_t createdNanos;              // CLOCK_REALTIME
+};
+
+struct traceRecord {
+    uint64_t arrivalNanos;              // CLOCK_REALTIME when the key frame arrived
+    uint64_t connection;                // Daemon pid << 32 | its connection number
+    uint32_t keyLength;
+    uint32_t messageLength;
+    uint8_t mode;
+    uint8_t flags;
+    uint8_t reserved[6];
+};
+
+extern char* tracePath;
+extern bool tracePayloads;
+
+void openTrace();
+uint64_t traceConnectionID(uint32_t connectionNumber);
+void recordTrace(uint64_t connection, char mode, bool checked, unsigned long long requestStart,
+                 const char* key, size_t keyLength, const char* message, size_t messageLength);
+
+#endif //OTP_TRACE_H
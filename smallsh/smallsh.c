@@ -2,23 +2,54 @@
  * Source file smallsh - a basic shell written in C
  * Define the functions for and execute the following functionality:
  *   expand $$ to current process id
- *   built-in commands: cd, status, exit
- *   fork and execute non-built-in commands
- *   allow processes to be run in the background with &
+ *   built-in commands: cd, status, exit, hash, jobs, fg, bg, wait, and
+ *   echo, printf, pwd, test, [, true, false, export, unset without a process,
+ *   found through a perfect hash of their names
+ *   remember where PATH commands were found
+ *   spawn (or fork) and execute non-built-in commands
+ *   allow processes to be run in the background with &, as numbered jobs
  *   allow file input and output redirection with < and >
+ *   connect commands into pipelines with |
  *   handle SIGINT (CTRL-C) and SIGTSTP (CTRL-Z) signals
+ *   report background processes done as they finish, by waiting on
+ *   input and a signalfd for SIGCHLD together
+ *   run a script file or -c commands without prompting, stopping at the
+ *   first failed command with -e
 *******************************************************************************/
 #include "smallsh.h"
 
-int main()
+int main(int argc, char *argv[])
 {
-    //Initialize signal handlers
+    //Initialize signal handlers, and SIGCHLD as an fd
     initSignalHandlers();
-
-    //Initialize array of background PIDs with defined starting list capacity
-    backgroundPIDs.size = 0;
-    backgroundPIDs.capacity = START_CAPACITY;
-    backgroundPIDs.pids = malloc(sizeof(int) * backgroundPIDs.capacity);
+    initChildSignals();
+
+    //Initialize table of jobs, by job ID and by PID
+    jobs.idCapacity = START_CAPACITY;
+    jobs.byID = calloc(jobs.idCapacity, sizeof(struct job*));
+    jobs.highestID = 0;
+    jobs.pidCapacity = JOB_TABLE_START_CAPACITY;
+    jobs.byPID = calloc(jobs.pidCapacity, sizeof(struct jobSlot));
+    jobs.numPIDs = 0;
+    jobs.numBackgroundRunning = 0;
+    jobs.numFinished = 0;
+
+    //Initialize list of background processes done but not yet reported
+    completedPIDs.size = 0;
+    completedPIDs.capacity = START_CAPACITY;
+    completedPIDs.entries = malloc(sizeof(struct completion) * completedPIDs.capacity);
+
+    //Initialize table of built-in commands
+    initBuiltins();
+
+    //Initialize buffer of shell input, holding all of a script or -c commands
+    initShellInput(argc, argv);
+
+    //Initialize table of command paths found on PATH
+    commandPaths.size = 0;
+    commandPaths.capacity = PATH_TABLE_START_CAPACITY;
+    commandPaths.entries = calloc(commandPaths.capacity, sizeof(struct pathEntry));
+    commandPaths.searchPath = NULL;
 
     //Initialize file names in struct to store IO info
     memset(ioFiles.inputFile, '\0', sizeof(ioFiles.inputFile));
@@ -27,14 +58,116 @@ int main()
     //Get starting directory
     startingDirectory = getWorkingDirectory(startingDirectory);
 
+    //Hand the terminal to foreground pipelines only if it is the shell's to give
+    shellGroup = getpgrp();
+    terminalControl = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == shellGroup;
+
     //Execute shell
     runShell();
 
     //Free memory still in use
-    free(backgroundPIDs.pids);
+    clearPathTable();
+    free(commandPaths.entries);
+    if (shellInput.mapped) { munmap(shellInput.data, shellInput.capacity); }
+    else { free(shellInput.data); }
+    free(completedPIDs.entries);
+    free(jobs.byPID);
+    free(jobs.byID);
     free(startingDirectory);
 
-    return 0;
+    //A script's caller sees how its last command went
+    return runningScript ? shellExitValue() : 0;
+}
+
+/******************************************************************************
+ * Parse options, and set up shell input to be read from stdin, or held
+ * whole from -c commands or a script file
+ * USAGE: smallsh [-e] [-c commands | script]
+*******************************************************************************/
+void initShellInput(int argc, char *argv[])
+{
+    char* commands = NULL;
+    int option;
+
+    shellInput.fd = STDIN_FILENO;
+    shellInput.start = shellInput.end = 0;
+    shellInput.atEnd = false;
+    shellInput.mapped = false;
+
+    while ((option = getopt(argc, argv, "+ec:")) != -1) {
+        switch (option) {
+            case 'e': stopOnError = true; break;
+            case 'c': commands = optarg; break;
+            default: fprintf(stderr, "%s\n", SHELL_USAGE); exit(2);
+        }
+    }
+
+    //Only one source of commands, and no script arguments ($1...) to expand
+    if (optind < argc - (commands ? 0 : 1)) {
+        fprintf(stderr, "%s\n", SHELL_USAGE);
+        exit(2);
+    }
+
+    if (commands) {
+        runningScript = true;
+        shellInput.data = strdup(commands);
+        shellInput.end = shellInput.capacity = strlen(commands);
+        shellInput.atEnd = true;
+    }
+    else if (optind < argc) {
+        runningScript = true;
+        loadScript(argv[optind]);
+    }
+    else {
+        shellInput.capacity = INPUT_START_CAPACITY;
+        shellInput.data = malloc(shellInput.capacity);
+    }
+}
+
+/******************************************************************************
+ * Hold the whole script file at path as shell input
+ * A regular file is mapped; anything else (a pipe, /dev/stdin) is read
+ * to its end, so stdin is left to the commands either way
+*******************************************************************************/
+void loadScript(const char *path)
+{
+    struct stat scriptInfo;
+
+    int scriptFD = open(path, O_RDONLY | O_CLOEXEC);
+    if (scriptFD == -1 || fstat(scriptFD, &scriptInfo) == -1) {
+        fprintf(stderr, "smallsh: %s: %s\n", path, strerror(errno));
+        exit(127);
+    }
+
+    if (S_ISREG(scriptInfo.st_mode) && scriptInfo.st_size > 0) {
+        shellInput.data = mmap(NULL, scriptInfo.st_size, PROT_READ, MAP_PRIVATE, scriptFD, 0);
+        if (shellInput.data != MAP_FAILED) {
+            madvise(shellInput.data, scriptInfo.st_size, MADV_SEQUENTIAL);
+            shellInput.end = shellInput.capacity = scriptInfo.st_size;
+            shellInput.mapped = true;
+            shellInput.atEnd = true;
+            close(scriptFD);
+            return;
+        }
+    }
+
+    shellInput.fd = scriptFD;
+    shellInput.capacity = INPUT_START_CAPACITY;
+    shellInput.data = malloc(shellInput.capacity);
+    while (!shellInput.atEnd) { readInput(); }
+    close(scriptFD);
+}
+
+/******************************************************************************
+ * Return status as a process exit value: a command's exit value, or 128
+ * plus the signal that terminated it
+*******************************************************************************/
+int shellExitValue()
+{
+    if (exitStatus == -5) { return 0; }                     //Last command was sent to the background
+    if (WIFSIGNALED(exitStatus)) { return 128 + WTERMSIG(exitStatus); }
+
+    return WEXITSTATUS(exitStatus);
 }
 
 /******************************************************************************
@@ -61,11 +194,30 @@ void initSignalHandlers() {
     sigaction(SIGTSTP, &SIGTSTP_action, NULL);
 }
 
+/******************************************************************************
+ * Block SIGCHLD and take it through a signalfd instead, so the shell can
+ * wait for a child to finish and for input at once
+ * Children start with the shell's mask as it was, without SIGCHLD blocked
+*******************************************************************************/
+void initChildSignals()
+{
+    sigset_t childSignal;
+
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &childSignalMask);
+
+    childSignalFD = signalfd(-1, &childSignal, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (childSignalFD == -1) { perror("signalfd"); exit(1); }
+}
+
 /******************************************************************************
  * Print message upon SIGINT (CTRL-C) termination
+ * Note it for the wait builtin
 *******************************************************************************/
 void catchSIGINT(int signalNum)
 {
+    interrupted = true;                 //Ends a wait builtin
 //    char* message = "Caught SIGINT\n";
 //    write(STDOUT_FILENO, message, 14);
 //    fflush(stdout);
@@ -107,13 +259,26 @@ void runShell()
         clearCommandArgs(commandArgs, MAX_ARGS);
 
         //Prompt user for command and parse into space-separated values
+        //Input that has run out ends the shell, leaving background jobs
+        //running as sh does
         userInput = promptCommandLine();
+        if (!userInput) {
+            leaveShell();
+            free(commandArgs);
+            break;
+        }
         saveCommandArgs(userInput, commandArgs);
 
         //Execute user command and check for completed background processes
         processCommandArgs(commandArgs);
         findCompletedProcesses();
 
+        //With -e, a failed command ends the shell; as it stops at the first,
+        //a failed status can only be this command's
+        if (stopOnError && continueExecution && shellExitValue() != 0) {
+            leaveShell();
+        }
+
         //Free allocated memory
         free(commandArgs);
         free(userInput);
@@ -122,36 +287,105 @@ void runShell()
 
 /******************************************************************************
  * Display the command line prompt
- * Return user input as string
+ * While waiting for input, report background processes as they finish,
+ * then prompt again
+ * A script or -c commands are already held whole, so are taken a line at
+ * a time with no prompt
+ * Return user input as string, or NULL when input has run out
 *******************************************************************************/
 char* promptCommandLine()
 {
-    int numChars = -5;
-    size_t bufferSize = 0;
+    struct pollfd waitFDs[2] = {{STDIN_FILENO, POLLIN, 0}, {childSignalFD, POLLIN, 0}};
     char* userInput = NULL;
+    bool showPrompt = !runningScript;
 
     while(1) {
 
         //Print prompt
-        printf(CMD_PROMPT);
-        fflush(stdout);
+        if (showPrompt) {
+            printf(CMD_PROMPT);
+            fflush(stdout);
+            showPrompt = false;
+        }
 
-        //Get user input and check for read errors
-        numChars = getline(&userInput, &bufferSize, stdin);
+        //Take the next line if it has been read already
+        if ((userInput = takeInputLine()) != NULL) { break; }
+        if (shellInput.atEnd) { return NULL; }
 
-        if (numChars == -1) {
-            clearerr(stdin);
+        //Wait for more input or a finished child
+        bool wasForegroundOnly = foregroundOnly;
+        if (poll(waitFDs, 2, -1) == -1) {
+            if (errno != EINTR) { perror("poll"); exit(1); }
+            showPrompt = (foregroundOnly != wasForegroundOnly);     //CTRL-Z printed a message
+            continue;
         }
-        else {
-            break;                          // Exit the loop
+
+        if (waitFDs[1].revents & POLLIN) {
+            reapChildren();
+            showPrompt = findCompletedProcesses() > 0;
+        }
+
+        //CTRL-D at a terminal only ends the line, as with getline
+        if ((waitFDs[0].revents & (POLLIN | POLLHUP | POLLERR)) && readInput() == 0 && isatty(STDIN_FILENO)) {
+            shellInput.atEnd = false;
+            showPrompt = true;
         }
     }
 
-    //Delete newline and expand $$ to PID
-    userInput[numChars-1] = '\0';
-    userInput = expandPID(userInput);
+    //Expand $$ to PID
+    char* expandedInput = expandPID(userInput);
+    free(userInput);
+
+    return expandedInput;
+}
+
+/******************************************************************************
+ * Remove the next whole line from shell input and return it without its
+ * newline; once input has run out, what is left counts as a line
+ * Return NULL if there is no line yet
+*******************************************************************************/
+char* takeInputLine()
+{
+    char* lineStart = shellInput.data + shellInput.start;
+    size_t available = shellInput.end - shellInput.start;
+    char* newline = memchr(lineStart, '\n', available);
+
+    if (!newline && !(shellInput.atEnd && available > 0)) { return NULL; }
+
+    size_t lineLength = newline ? (size_t)(newline - lineStart) : available;
+    char* line = strndup(lineStart, lineLength);
+    shellInput.start += lineLength + (newline ? 1 : 0);
+
+    return line;
+}
+
+/******************************************************************************
+ * Read whatever stdin (or a script) has ready onto the end of shell input, making room
+ * Return the number of chars read; 0 marks input as run out
+*******************************************************************************/
+ssize_t readInput()
+{
+    //Move unread input to the front, and grow if it fills the buffer
+    if (shellInput.start > 0) {
+        memmove(shellInput.data, shellInput.data + shellInput.start, shellInput.end - shellInput.start);
+        shellInput.end -= shellInput.start;
+        shellInput.start = 0;
+    }
+    if (shellInput.end == shellInput.capacity) {
+        shellInput.capacity *= 2;
+        shellInput.data = realloc(shellInput.data, shellInput.capacity);
+    }
+
+    ssize_t numChars = read(shellInput.fd, shellInput.data + shellInput.end, shellInput.capacity - shellInput.end);
+    if (numChars == -1) {
+        if (errno == EINTR || errno == EAGAIN) { return -1; }
+        numChars = 0;                                           //Unreadable input has run out too
+    }
+
+    if (numChars == 0) { shellInput.atEnd = true; }
+    shellInput.end += (size_t)numChars;
 
-    return userInput;
+    return numChars;
 }
 
 /******************************************************************************
@@ -249,43 +483,30 @@ void saveCommandArgs(char *userInput, char** commandArgs)
 /******************************************************************************
  * Take array of string command args
  * Check if array[0] (i.e., the command) is not valid
- * If a built-in command (cd, status, exit), execute the command
+ * A pipeline runs every stage as a process, built-in or not
+ * If a built-in command (cd, status, exit, hash, jobs, fg, bg, wait,
+ * echo, printf, pwd, test, [, true, false, export, unset), execute the
+ * command in the shell
  * Else pass command args to be forked and executed
 *******************************************************************************/
 void processCommandArgs(char** commandArgs)
 {
     char* command = commandArgs[0];
+    struct builtin* builtin = NULL;
 
     //Check for empty commands or comments
     if ( command == NULL || command[0] == '#' || command[0] == ' ' ) {
         return;
     }
 
-    //Check for cd
-    else if (strcmp(command, "cd") == 0) {
-        char* path = commandArgs[1];
-        changeDirectory(path);
-    }
-
-    //Check for status
-    else if (strcmp(command, "status") == 0) {
-
-        // If process terminated normally
-        if (WIFEXITED(exitStatus)) {
-            printf("exit value %d\n", WEXITSTATUS(exitStatus));
-            fflush(stdout);
-        }
-
-        // Else process terminated by a signal
-        else if (WIFSIGNALED(exitStatus)) {
-            printf("terminated by signal %d\n", WTERMSIG(exitStatus));
-            fflush(stdout);
-        }
+    //Check for a pipeline of commands
+    else if (isPipeline(commandArgs)) {
+        executeNewProcess(commandArgs);
     }
 
-    //Check for exit
-    else if (strcmp(command, "exit") == 0) {
-        exitShell();
+    //Check for a built-in command, run in the shell itself
+    else if ((builtin = findBuiltin(command)) != NULL) {
+        runBuiltin(builtin, commandArgs);
     }
 
     //Otherwise execute specified command
@@ -317,253 +538,1720 @@ void changeDirectory(char *path)
 }
 
 /******************************************************************************
- * Takes a list of command argument strings as its parameter
- * Forks a child process; Sets signal handling and redirects IO
- * as needed for foreground / background processes,
- * Execs process specified in 1st command arg
- * Waits for a foreground process
- * If a background process, prints PID and saves PID to list of background processes
+ * Place every built-in command in the builtin table at its name's hash
+ * The hash was chosen to give each a slot of its own; a clash is a bug
 *******************************************************************************/
-void executeNewProcess(char **commandArgs)
+void initBuiltins()
 {
-    char* command = commandArgs[0];
-    exitStatus = -5;
-    pid_t spawnPID = -5;
+    struct builtin builtinList[] = {
+        {"cd", changeDirectoryBuiltin},
+        {"status", printStatus},
+        {"exit", exitShellBuiltin},
+        {"hash", hashCommands},
+        {"jobs", listJobs},
+        {"fg", foregroundJob},
+        {"bg", backgroundJob},
+        {"wait", waitForJobs},
+        {"echo", echoArgs},
+        {"printf", printFormatted},
+        {"pwd", printWorkingDirectory},
+        {"test", testExpression},
+        {"[", testExpression},
+        {"true", returnTrue},
+        {"false", returnFalse},
+        {"export", exportVariables},
+        {"unset", unsetVariables},
+    };
+
+    for (size_t i = 0; i < sizeof(builtinList) / sizeof(builtinList[0]); i++) {
+        struct builtin* slot = &builtins[hashBuiltinName(builtinList[i].name)];
+        if (slot->name) {
+            fprintf(stderr, "smallsh: builtins %s and %s share a slot\n", slot->name, builtinList[i].name);
+            exit(1);
+        }
+        *slot = builtinList[i];
+    }
+}
 
-    //Fork and exec specified process
-    spawnPID = fork();
-    switch (spawnPID) {
-        case -1:
-            perror("fork"); exit(1);
-            break;
+/******************************************************************************
+ * Hash a command name by its length and its first and last chars
+ * Multipliers were searched for to keep every builtin in its own slot
+*******************************************************************************/
+unsigned int hashBuiltinName(const char *name)
+{
+    size_t length = strlen(name);
+    unsigned int hash = (unsigned int)length * 3 + (unsigned char)name[0] + (unsigned char)name[length - 1] * 6;
 
-        case 0:
+    return hash & (BUILTIN_TABLE_SIZE - 1);
+}
 
-            sigaction(SIGTSTP, &ignore_action, NULL);           //Child processes ignore SIGTSTP (CTRL-Z)
-            saveIORedirects(commandArgs);                       //Find any redirection
+/******************************************************************************
+ * Return the built-in command named by passed-in command, or NULL
+ * One slot is checked, so other commands cost one hash and one strcmp
+*******************************************************************************/
+struct builtin* findBuiltin(const char *command)
+{
+    struct builtin* slot = &builtins[hashBuiltinName(command)];
 
-            //If background process, ignore SIGINT and redirect IO to /dev/null
-            if (backgroundProcess && !foregroundOnly) {
+    if (slot->name && strcmp(slot->name, command) == 0) { return slot; }
+    return NULL;
+}
 
-                sigaction(SIGINT, &ignore_action, NULL);
+/******************************************************************************
+ * Run a built-in command in the shell, with stdin and stdout redirected
+ * to any < and > files for its duration, then put back
+ * A file that cannot be opened is reported as for a process, with status
+ * 1 for input and 2 for output, and the command is not run
+*******************************************************************************/
+void runBuiltin(struct builtin *builtin, char **commandArgs)
+{
+    int savedInput = -1;
+    int savedOutput = -1;
+    int fileFD = -1;
+    bool redirected = true;
 
-                if (strlen(ioFiles.inputFile) == 0) {           //If no file otherwise specified
-                    strcpy(ioFiles.inputFile, "/dev/null");
-                }
-                if (strlen(ioFiles.outputFile) == 0) {
-                    strcpy(ioFiles.outputFile, "/dev/null");
-                }
-            }
+    saveIORedirects(commandArgs);                           //Also flushes stdout
 
-            //Redirect IO and execute, check for errors
-            redirectIO();
-            exitStatus = execvp(command, commandArgs);
-            if (exitStatus == -1) {
-                printf("%s: ", command);
-                fflush(stdout);
-                perror("");
-                exit(1);
-            }
+    if (strlen(ioFiles.inputFile) != 0) {
+        fileFD = open(ioFiles.inputFile, O_RDONLY | O_CLOEXEC);
+        if (fileFD == -1) {
+            printf("cannot open %s for input\n", ioFiles.inputFile);
+            exitStatus = EXIT_STATUS(1);
+            redirected = false;
+        }
+        else {
+            savedInput = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+            dup2(fileFD, STDIN_FILENO);
+            close(fileFD);
+        }
+    }
 
-            break;
+    if (redirected && strlen(ioFiles.outputFile) != 0) {
+        fileFD = open(ioFiles.outputFile, O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+        if (fileFD == -1) {
+            printf("cannot open %s for output\n", ioFiles.outputFile);
+            exitStatus = EXIT_STATUS(2);
+            redirected = false;
+        }
+        else {
+            savedOutput = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+            dup2(fileFD, STDOUT_FILENO);
+            close(fileFD);
+        }
+    }
 
-        default:
-//            printf("Parent process: %d\n", getpid());
-//            fflush(stdout);
-            break;
+    if (redirected) { builtin->run(commandArgs); }
+
+    //Output goes out before the next command's, and to the right file
+    fflush(stdout);
+    if (savedInput != -1) {
+        dup2(savedInput, STDIN_FILENO);
+        close(savedInput);
+    }
+    if (savedOutput != -1) {
+        dup2(savedOutput, STDOUT_FILENO);
+        close(savedOutput);
     }
+}
 
-    //If a background process, add to background list and do not wait
-    if (backgroundProcess && !foregroundOnly) {
-        addToProcessList((int)spawnPID, &backgroundPIDs);
+/******************************************************************************
+ * Built-in cd: change to the path given, or HOME
+*******************************************************************************/
+void changeDirectoryBuiltin(char **commandArgs)
+{
+    changeDirectory(commandArgs[1]);
+}
 
-        printf("background pid is %d\n", (int)spawnPID);
+/******************************************************************************
+ * Built-in status: print the exit value or terminating signal of the last
+ * foreground process
+*******************************************************************************/
+void printStatus(char **commandArgs)
+{
+    // If process terminated normally
+    if (WIFEXITED(exitStatus)) {
+        printf("exit value %d\n", WEXITSTATUS(exitStatus));
         fflush(stdout);
     }
 
-    //Else wait if foreground process, print if terminated by a signal
-    else if (!backgroundProcess){
-        waitpid(spawnPID, &exitStatus, 0);
-
-        if (WIFSIGNALED(exitStatus)) {
-            printf("terminated by signal %d\n", WTERMSIG(exitStatus));
-            fflush(stdout);
-        }
+    // Else process terminated by a signal
+    else if (WIFSIGNALED(exitStatus)) {
+        printf("terminated by signal %d\n", WTERMSIG(exitStatus));
+        fflush(stdout);
     }
 }
 
 /******************************************************************************
- * Save input and/or output file names
+ * Built-in exit
 *******************************************************************************/
-void saveIORedirects(char **commandArgs)
+void exitShellBuiltin(char **commandArgs)
 {
-    memset(ioFiles.inputFile, '\0', MAX_CHARS);
-    memset(ioFiles.outputFile, '\0', MAX_CHARS);
+    exitShell();
+}
 
-    //Start with second command arg
+/******************************************************************************
+ * Built-in echo: print args separated by spaces, then a newline
+ * As coreutils echo: -n leaves off the newline, -e reads backslash
+ * escapes, -E does not (the default)
+*******************************************************************************/
+void echoArgs(char **commandArgs)
+{
+    bool newline = true;
+    bool escapes = false;
     int index = 1;
-    char* command = commandArgs[index];
 
-    //Find redirection operators and save following fileName
-    while (command) {
+    //Options only count if every char is one
+    for (; commandArgs[index] && commandArgs[index][0] == '-' && commandArgs[index][1]; index++) {
+        const char* option = commandArgs[index] + 1;
+        if (strspn(option, "neE") != strlen(option)) { break; }
 
-        if (strcmp(command, ">") == 0 || strcmp(command, "<") == 0) {
+        for (; *option; option++) {
+            if (*option == 'n') { newline = false; }
+            else { escapes = (*option == 'e'); }
+        }
+    }
 
-            if (strcmp(command, ">") == 0) {
-                strcpy(ioFiles.outputFile, commandArgs[index + 1]);
-            }
+    for (bool first = true; commandArgs[index]; index++, first = false) {
+        if (!first) { putchar(' '); }
 
-            else if (strcmp(command, "<") == 0) {
-                strcpy(ioFiles.inputFile, commandArgs[index + 1]);
-            }
+        if (!escapes) {
+            fputs(commandArgs[index], stdout);
+            continue;
+        }
+        for (const char* text = commandArgs[index]; *text; ) {
+            if (*text != '\\') { putchar(*text++); }
+            else if (!printEscape(&text)) { exitStatus = EXIT_STATUS(0); return; }   //\c ends output
+        }
+    }
 
-            //Move next arguments "left" and reset index
-            if (index + 2 < MAX_ARGS) {                         //Check array bounds
-                commandArgs[index] = commandArgs[index + 2];
-                commandArgs[index + 1] = commandArgs[index + 3];
+    if (newline) { putchar('\n'); }
+    exitStatus = EXIT_STATUS(0);
+}
 
-                commandArgs[index + 2] = NULL;
-                commandArgs[index + 3] = NULL;
+/******************************************************************************
+ * Print the backslash escape passed-in text points to, and move past it:
+ * \\ \a \b \e \f \n \r \t \v, or up to 3 octal digits (after \0 or not)
+ * An unknown escape is printed as it is
+ * Return false for \c, which ends output
+*******************************************************************************/
+bool printEscape(const char **text)
+{
+    const char* escape = *text + 1;
+    const char* escapeChars = "\\\\a\ab\be\033f\fn\nr\rt\tv\v";
+    const char* found = NULL;
+
+    if (*escape == 'c') { return false; }
+    if (*escape == '\0') {
+        putchar('\\');
+        *text = escape;
+        return true;
+    }
 
-                index--;
-            }
+    //Octal value
+    if (*escape >= '0' && *escape <= '7') {
+        int value = 0;
+        int numDigits = (*escape == '0') ? 4 : 3;           //\0 leads up to 3 more
+        for (; numDigits > 0 && *escape >= '0' && *escape <= '7'; numDigits--) {
+            value = value * 8 + (*escape++ - '0');
         }
+        putchar(value & 0xff);
+        *text = escape;
+        return true;
+    }
 
-        //Get next command
-        index++;
-        command = commandArgs[index];
+    for (const char* pair = escapeChars; *pair; pair += 2) {
+        if (*pair == *escape) { found = pair + 1; break; }
+    }
+    if (found) { putchar(*found); }
+    else {
+        putchar('\\');
+        putchar(*escape);
     }
 
-    fflush(stdout);
+    *text = escape + 1;
+    return true;
 }
 
 /******************************************************************************
- * Redirect input and output to file names saved in redirectFiles struct
+ * Built-in printf: print args through the format, with backslash escapes
+ * Conversions %d %i %o %u %x %X %c %s %b %e %E %f %g %G %% take flags,
+ * width and precision; the format is reused until args run out, and a
+ * missing arg counts as empty or 0
+ * An arg that is not a number is reported, printed as what it starts
+ * with, and makes status 1
 *******************************************************************************/
-void redirectIO() {
-
-    //Resource: https://www.unix.com/programming/268879-c-unix-how-redirect-stdout-file-c-code.html
-    //Resource: http://www.cs.loyola.edu/~jglenn/702/S2005/Examples/dup2.html
+void printFormatted(char **commandArgs)
+{
+    char spec[64];
+    const char* format = commandArgs[1];
+    char** args = &commandArgs[2];
+    int status = 0;
+
+    if (!format) {
+        printf("printf: usage: printf format [arguments]\n");
+        exitStatus = EXIT_STATUS(2);
+        return;
+    }
 
-    int inputFD = -5;
-    int outputFD = -5;
-    int fileResult = -5;
+    do {
+        char** firstArg = args;
 
-    //Redirect input
-    if (strlen(ioFiles.inputFile) != 0) {
-        inputFD = open(ioFiles.inputFile, O_RDONLY);
-        if (inputFD == -1) {
-            printf("cannot open %s for input\n", ioFiles.inputFile);
-            fflush(stdout);
-            exit(1);
-        }
+        for (const char* text = format; *text; ) {
+            if (*text == '\\') {
+                if (!printEscape(&text)) { exitStatus = EXIT_STATUS(status); return; }
+                continue;
+            }
+            if (*text != '%') {
+                putchar(*text++);
+                continue;
+            }
+            if (text[1] == '%') {
+                putchar('%');
+                text += 2;
+                continue;
+            }
 
-        fileResult = dup2(inputFD, STDIN_FILENO);
-        if (fileResult == -1) { perror("input dup2"); exit(1); }
-    }
+            //Copy flags, width and precision, then add the length for its type
+            size_t specLength = 1 + strspn(text + 1, "-+ #0");
+            specLength += strspn(text + specLength, "0123456789");
+            if (text[specLength] == '.') { specLength += 1 + strspn(text + specLength + 1, "0123456789"); }
+            char conversion = text[specLength];
+            if (conversion == '\0' || !strchr("diouxXcsbeEfgG", conversion) || specLength > sizeof(spec) - 4) {
+                printf("printf: %.*s: invalid conversion\n", (int)specLength + (conversion ? 1 : 0), text);
+                exitStatus = EXIT_STATUS(1);
+                return;
+            }
+            memcpy(spec, text, specLength);
+            text += specLength + 1;
+
+            const char* arg = *args ? *args++ : "";
+            char* end = NULL;
+            errno = 0;
+
+            if (conversion == 'd' || conversion == 'i') {
+                long long value = strtoll(arg, &end, 0);
+                if (*arg == '\'' || *arg == '"') { value = (unsigned char)arg[1]; end = ""; }
+                sprintf(spec + specLength, "ll%c", conversion);
+                printf(spec, value);
+            }
+            else if (strchr("ouxX", conversion)) {
+                unsigned long long value = strtoull(arg, &end, 0);
+                if (*arg == '\'' || *arg == '"') { value = (unsigned char)arg[1]; end = ""; }
+                sprintf(spec + specLength, "ll%c", conversion);
+                printf(spec, value);
+            }
+            else if (strchr("eEfgG", conversion)) {
+                double value = strtod(arg, &end);
+                sprintf(spec + specLength, "%c", conversion);
+                printf(spec, value);
+            }
+            else if (conversion == 'c') {
+                sprintf(spec + specLength, "c");
+                printf(spec, *arg);
+            }
+            else if (conversion == 's') {
+                sprintf(spec + specLength, "s");
+                printf(spec, arg);
+            }
+            else {
+                //%b: the arg's own escapes are read, and \c ends all output
+                for (const char* argText = arg; *argText; ) {
+                    if (*argText != '\\') { putchar(*argText++); }
+                    else if (!printEscape(&argText)) { exitStatus = EXIT_STATUS(status); return; }
+                }
+            }
 
-    //Redirect output
-    if (strlen(ioFiles.outputFile) != 0) {
-        outputFD = open(ioFiles.outputFile, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-        if (outputFD == -1) {
-            printf("cannot open %s for output\n", ioFiles.outputFile);
-            fflush(stdout);
-            exit(2);
+            if (end && (*end || errno) && *arg) {
+                fflush(stdout);
+                fprintf(stderr, "printf: %s: invalid number\n", arg);
+                status = 1;
+            }
         }
 
-        fileResult = dup2(outputFD, STDOUT_FILENO);
-        if (fileResult == -1) { perror("output dup2"); exit(2); }
-    }
+        //Stop if the format took no args, as it never will
+        if (args == firstArg) { break; }
+    } while (*args);
+
+    exitStatus = EXIT_STATUS(status);
 }
 
 /******************************************************************************
- * Resize PID array if more capacity needed
- * Add passed-in PID to list
+ * Built-in pwd: print the current directory
 *******************************************************************************/
-void addToProcessList(int pid, struct pidList *processList)
+void printWorkingDirectory(char **commandArgs)
 {
-    //Resource: https://stackoverflow.com/questions/3536153/c-dynamically-growing-array
+    char* directory = getWorkingDirectory(NULL);
 
-    if (processList->size >= processList->capacity) {
-        processList->capacity *= 2;
-        processList->pids = realloc(processList->pids, processList->capacity * sizeof(int));
+    if (!directory) {
+        perror("pwd");
+        exitStatus = EXIT_STATUS(1);
+        return;
     }
 
-    processList->pids[processList->size++] = pid;
+    printf("%s\n", directory);
+    free(directory);
+    exitStatus = EXIT_STATUS(0);
 }
 
 /******************************************************************************
- * Find the passed-in PID in the passed-in process list
- * Remove by shifting all later values and decrement process list size
+ * Built-in test and [: status 0 if the expression is true, 1 if false,
+ * 2 if it cannot be read
+ * [ needs ] as its last arg
 *******************************************************************************/
-void deleteFromProcessList(int pid, struct pidList *processList)
+void testExpression(char **commandArgs)
 {
-    //Traverse process list to find matching PID
-    for (int i = 0; i < processList->size; i++) {
-
-        if (processList->pids[i] == pid) {
-
-            //Delete by shifting all other PIDs "left"
-            for (int j = i; j < processList->size; j++) {
-
-                processList->pids[j] = processList->pids[j+1];
-                processList->size--;
-                return;
-            }
+    int numArgs = 0;
+    while (commandArgs[numArgs + 1]) { numArgs++; }
+
+    if (strcmp(commandArgs[0], "[") == 0) {
+        if (numArgs == 0 || strcmp(commandArgs[numArgs], "]") != 0) {
+            printf("[: missing ]\n");
+            exitStatus = EXIT_STATUS(2);
+            return;
         }
+        numArgs--;
     }
+
+    exitStatus = EXIT_STATUS(evaluateTest(&commandArgs[1], numArgs));
 }
 
 /******************************************************************************
- * Traverse background processes array for completed processes
- * For all completed, print message with PID and exit/termination method
- * Remove PID from background process list
+ * Evaluate a test expression by its number of args, as POSIX sets out for
+ * up to 4: a string is true if not empty; unary file and string tests;
+ * binary string and integer comparisons; ! negates; ( ) groups one test
+ * Return 0 if true, 1 if false, 2 if the expression cannot be read
 *******************************************************************************/
-void findCompletedProcesses()
+int evaluateTest(char **args, int numArgs)
 {
-    pid_t completed = -5;
-    int exitMethod = -5;
-
-    //Use do-while loop to ensure no remaining processes
-    //For loop may miss completed process if already iterated over
+    struct stat fileInfo;
+    const char* unaryOps = "bcdefhLprSstwxnz";
+    int result = -1;
 
-    do {
-        // Check for any completed process
-        completed = waitpid(-1, &exitMethod, WNOHANG);
+    if (numArgs == 0) { return 1; }
+    if (numArgs == 1) { return args[0][0] ? 0 : 1; }
 
-        // If PID returned
-        if (completed > 0) {
-            printf("background pid %d is done: ", completed);
-            fflush(stdout);
+    //A binary operator in the middle of 3 args comes before ! and ( )
+    if (numArgs == 3 && (result = compareTest(args[0], args[1], args[2])) != -1) { return result; }
 
-            // If process terminated normally
-            if (WIFEXITED(exitMethod)) {
-                printf("exit value %d\n", WEXITSTATUS(exitMethod));
+    if (numArgs <= 4 && strcmp(args[0], "!") == 0) {
+        result = evaluateTest(&args[1], numArgs - 1);
+        return (result == 2) ? 2 : !result;
+    }
+    if (numArgs <= 4 && strcmp(args[0], "(") == 0 && strcmp(args[numArgs - 1], ")") == 0) {
+        return evaluateTest(&args[1], numArgs - 2);
+    }
+
+    if (numArgs == 3) {
+        printf("test: %s: binary operator expected\n", args[1]);
+        return 2;
+    }
+    if (numArgs > 2) {
+        printf("test: too many arguments\n");
+        return 2;
+    }
+
+    //Unary test
+    const char* operand = args[1];
+    if (args[0][0] != '-' || strlen(args[0]) != 2 || !strchr(unaryOps, args[0][1])) {
+        printf("test: %s: unary operator expected\n", args[0]);
+        return 2;
+    }
+
+    switch (args[0][1]) {
+        case 'n': return operand[0] ? 0 : 1;
+        case 'z': return operand[0] ? 1 : 0;
+        case 't': return isatty(atoi(operand)) ? 0 : 1;
+        case 'r': return access(operand, R_OK) == 0 ? 0 : 1;
+        case 'w': return access(operand, W_OK) == 0 ? 0 : 1;
+        case 'x': return access(operand, X_OK) == 0 ? 0 : 1;
+        case 'h':
+        case 'L': return (lstat(operand, &fileInfo) == 0 && S_ISLNK(fileInfo.st_mode)) ? 0 : 1;
+    }
+
+    if (stat(operand, &fileInfo) != 0) { return 1; }
+    switch (args[0][1]) {
+        case 'b': return S_ISBLK(fileInfo.st_mode) ? 0 : 1;
+        case 'c': return S_ISCHR(fileInfo.st_mode) ? 0 : 1;
+        case 'd': return S_ISDIR(fileInfo.st_mode) ? 0 : 1;
+        case 'f': return S_ISREG(fileInfo.st_mode) ? 0 : 1;
+        case 'p': return S_ISFIFO(fileInfo.st_mode) ? 0 : 1;
+        case 'S': return S_ISSOCK(fileInfo.st_mode) ? 0 : 1;
+        case 's': return fileInfo.st_size > 0 ? 0 : 1;
+        default: return 0;                                      //-e
+    }
+}
+
+/******************************************************************************
+ * Compare left and right by a binary test operator: = and != as strings,
+ * -eq -ne -lt -le -gt -ge as integers
+ * Return 0 if true, 1 if false, 2 if not integers, -1 if op is not one
+*******************************************************************************/
+int compareTest(const char *left, const char *op, const char *right)
+{
+    const char* integerOps[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    const char* operands[2] = {left, right};
+    long long values[2];
+
+    if (strcmp(op, "=") == 0) { return strcmp(left, right) == 0 ? 0 : 1; }
+    if (strcmp(op, "!=") == 0) { return strcmp(left, right) != 0 ? 0 : 1; }
+
+    int opIndex = 0;
+    while (opIndex < 6 && strcmp(op, integerOps[opIndex]) != 0) { opIndex++; }
+    if (opIndex == 6) { return -1; }
+
+    for (int side = 0; side < 2; side++) {
+        char* end = NULL;
+        errno = 0;
+        values[side] = strtoll(operands[side], &end, 10);
+        if (!operands[side][0] || *end || errno) {
+            printf("test: %s: integer expected\n", operands[side]);
+            return 2;
+        }
+    }
+
+    switch (opIndex) {
+        case 0: return values[0] == values[1] ? 0 : 1;
+        case 1: return values[0] != values[1] ? 0 : 1;
+        case 2: return values[0] < values[1] ? 0 : 1;
+        case 3: return values[0] <= values[1] ? 0 : 1;
+        case 4: return values[0] > values[1] ? 0 : 1;
+        default: return values[0] >= values[1] ? 0 : 1;
+    }
+}
+
+/******************************************************************************
+ * Built-in true: status 0
+*******************************************************************************/
+void returnTrue(char **commandArgs)
+{
+    exitStatus = EXIT_STATUS(0);
+}
+
+/******************************************************************************
+ * Built-in false: status 1
+*******************************************************************************/
+void returnFalse(char **commandArgs)
+{
+    exitStatus = EXIT_STATUS(1);
+}
+
+/******************************************************************************
+ * Return whether the first length chars of name make a variable name:
+ * letters, digits and _, not starting with a digit
+*******************************************************************************/
+bool isVariableName(const char *name, size_t length)
+{
+    if (length == 0 || (name[0] >= '0' && name[0] <= '9')) { return false; }
+
+    for (size_t i = 0; i < length; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/******************************************************************************
+ * Built-in export: set each NAME=value in the environment commands get
+ * A NAME alone is already exported, as smallsh has no other variables
+ * With no args, list the environment
+ * Command paths found on an old PATH are forgotten
+*******************************************************************************/
+void exportVariables(char **commandArgs)
+{
+    int status = 0;
+
+    if (!commandArgs[1]) {
+        for (char** variable = environ; *variable; variable++) {
+            printf("export %s\n", *variable);
+        }
+        exitStatus = EXIT_STATUS(0);
+        return;
+    }
+
+    for (int i = 1; commandArgs[i]; i++) {
+        char* equals = strchr(commandArgs[i], '=');
+        size_t nameLength = equals ? (size_t)(equals - commandArgs[i]) : strlen(commandArgs[i]);
+
+        if (!isVariableName(commandArgs[i], nameLength)) {
+            printf("export: %s: not a valid identifier\n", commandArgs[i]);
+            status = 1;
+            continue;
+        }
+        if (!equals) { continue; }
+
+        *equals = '\0';
+        if (setenv(commandArgs[i], equals + 1, 1) == -1) {
+            perror("export");
+            status = 1;
+        }
+        if (strcmp(commandArgs[i], "PATH") == 0) { clearPathTable(); }
+        *equals = '=';
+    }
+
+    exitStatus = EXIT_STATUS(status);
+}
+
+/******************************************************************************
+ * Built-in unset: remove each named variable from the environment
+ * Command paths found on an old PATH are forgotten
+*******************************************************************************/
+void unsetVariables(char **commandArgs)
+{
+    int status = 0;
+
+    for (int i = 1; commandArgs[i]; i++) {
+        if (!isVariableName(commandArgs[i], strlen(commandArgs[i]))) {
+            printf("unset: %s: not a valid identifier\n", commandArgs[i]);
+            status = 1;
+            continue;
+        }
+
+        unsetenv(commandArgs[i]);
+        if (strcmp(commandArgs[i], "PATH") == 0) { clearPathTable(); }
+    }
+
+    exitStatus = EXIT_STATUS(status);
+}
+/******************************************************************************
+ * Return whether the command args hold a | joining commands into a pipeline
+*******************************************************************************/
+bool isPipeline(char **commandArgs)
+{
+    for (int i = 0; commandArgs[i]; i++) {
+        if (strcmp(commandArgs[i], PIPE_OPERATOR) == 0) { return true; }
+    }
+
+    return false;
+}
+
+/******************************************************************************
+ * Takes a list of command argument strings, maybe joined by |, as its parameter
+ * Runs them as one job: every stage starts at once, each reading the
+ * previous stage's output through a pipe
+ * Finds any redirection; a stage's own < or > takes the place of its pipe,
+ * and a background job reads from and writes to /dev/null at its ends
+ * A background job or pipeline gets a process group of its own, which a
+ * foreground pipeline holds the terminal with; a single foreground command
+ * stays in the shell's group, so CTRL-Z still reaches the shell
+ * Launches each process with posix_spawn, or with fork if it cannot be spawned
+ * Waits for a foreground job; status is its last stage's
+ * If a background job, prints its (last stage's) PID and keeps it in the job table
+*******************************************************************************/
+void executeNewProcess(char **commandArgs)
+{
+    char** stages[MAX_ARGS];
+    char* stageArgs[MAX_ARGS];
+    int numStages = 0;
+    int pipeFDs[2] = {-1, -1};
+    int previousOutput = -1;                                    //Read end of the last stage's pipe
+    pid_t spawnPID = -5;
+    bool inBackground = backgroundProcess && !foregroundOnly;
+
+    exitStatus = -5;
+    char* commandLine = joinCommandArgs(commandArgs);
+
+    //Split command args into stages at each |
+    stages[numStages++] = commandArgs;
+    for (int i = 0; commandArgs[i]; i++) {
+        if (strcmp(commandArgs[i], PIPE_OPERATOR) == 0) {
+            commandArgs[i] = NULL;
+            stages[numStages++] = &commandArgs[i + 1];
+        }
+    }
+
+    for (int i = 0; i < numStages; i++) {
+        if (stages[i][0] == NULL) {
+            printf("syntax error near %s\n", PIPE_OPERATOR);
+            fflush(stdout);
+            exitStatus = EXIT_STATUS(1);
+            free(commandLine);
+            return;
+        }
+    }
+
+    struct job* job = createJob(commandLine, numStages, inBackground);
+    pid_t group = (inBackground || numStages > 1) ? 0 : NO_PROCESS_GROUP;
+
+    //Start every stage before waiting on any, so they run side by side
+    for (int i = 0; i < numStages; i++) {
+        bool lastStage = (i == numStages - 1);
+
+        pipeFDs[0] = pipeFDs[1] = -1;
+        if (!lastStage && pipe2(pipeFDs, O_CLOEXEC) == -1) { perror("pipe"); exit(1); }
+
+        //Stage gets its own args, as removing its redirects shifts later args
+        clearCommandArgs(stageArgs, MAX_ARGS);
+        for (int j = 0; stages[i][j]; j++) { stageArgs[j] = stages[i][j]; }
+
+        saveIORedirects(stageArgs);                             //Find any redirection
+        if (inBackground) {
+            if (i == 0 && strlen(ioFiles.inputFile) == 0) {     //If no file otherwise specified
+                strcpy(ioFiles.inputFile, "/dev/null");
+            }
+            if (lastStage && strlen(ioFiles.outputFile) == 0) {
+                strcpy(ioFiles.outputFile, "/dev/null");
+            }
+        }
+
+        spawnPID = launchProcess(stageArgs, inBackground, previousOutput, pipeFDs[1], group);
+        if (spawnPID > 0) { addJobProcess(job, spawnPID, i); }
+
+        //The stages hold their own copies of the pipe ends now
+        if (previousOutput != -1) { close(previousOutput); }
+        if (pipeFDs[1] != -1) { close(pipeFDs[1]); }
+        previousOutput = pipeFDs[0];
+
+        //First stage started leads the process group
+        if (spawnPID > 0 && group == 0) {
+            group = job->group = spawnPID;
+            if (!inBackground) { giveTerminal(group); }
+        }
+    }
+
+    //Nothing could be started; status already set and reported
+    job->status = exitStatus;                                   //Kept if the last stage never started
+    if (job->numLive == 0) {
+        giveTerminal(shellGroup);
+        removeJob(job);
+        return;
+    }
+
+    //If a background job, leave it running in the job table and do not wait
+    if (inBackground) {
+        printf("background pid is %d\n", (int)job->reportPID);
+        fflush(stdout);
+    }
+
+    //Else wait if foreground job, print if terminated by a signal
+    else {
+        waitForJob(job);
+        finishForegroundJob(job);
+    }
+}
+
+/******************************************************************************
+ * Make passed-in process group the terminal's foreground group, if the
+ * shell controls the terminal
+ * A stage that read the terminal before it was handed over has stopped,
+ * so the group is continued as well
+*******************************************************************************/
+void giveTerminal(pid_t processGroup)
+{
+    sigset_t ttouSignal, savedMask;
+
+    if (!terminalControl) { return; }
+
+    //The shell is not in the foreground group when taking the terminal back
+    sigemptyset(&ttouSignal);
+    sigaddset(&ttouSignal, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &ttouSignal, &savedMask);
+    tcsetpgrp(STDIN_FILENO, processGroup);
+    sigprocmask(SIG_SETMASK, &savedMask, NULL);
+
+    if (processGroup != shellGroup) { kill(-processGroup, SIGCONT); }
+}
+
+/******************************************************************************
+ * Launch the process in commandArgs with posix_spawn, or with fork if it
+ * cannot be spawned; see spawnNewProcess for the parameters
+*******************************************************************************/
+pid_t launchProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup)
+{
+    pid_t spawnPID = -1;
+
+#ifndef FORK_LAUNCH
+    spawnPID = spawnNewProcess(commandArgs, inBackground, stageInput, stageOutput, processGroup);
+#endif
+    if (spawnPID == -1) {
+        spawnPID = forkNewProcess(commandArgs, inBackground, stageInput, stageOutput, processGroup);
+    }
+
+    return spawnPID;
+}
+
+/******************************************************************************
+ * Launch the process in commandArgs with posix_spawn, which never copies
+ * the shell's page tables (glibc uses clone with CLONE_VM | CLONE_VFORK)
+ * The redirect files are opened here so failures report as they always
+ * have, and become the child's stdin/stdout through dup2 file actions
+ * The child's SIGTSTP (and SIGINT if in background) is ignored by
+ * ignoring it in the shell for the duration of the spawn, with both
+ * blocked so a CTRL-C or CTRL-Z meanwhile reaches the shell's handlers
+ * A child in a process group of its own gets default SIGINT and SIGTSTP
+ * instead: the terminal only signals it once fg gives it the terminal,
+ * and then CTRL-C ends its job and CTRL-Z stops it
+ * stageInput and stageOutput are pipe ends to use as stdin and stdout,
+ * or -1; a redirect file takes their place
+ * processGroup is a group to join, 0 for a new one, or NO_PROCESS_GROUP
+ * to stay in the shell's
+ * Returns the child's PID, 0 if it could not be started, or -1 if
+ * posix_spawn itself is unavailable, or the command is a script with no
+ * #! line, which only execvp runs (with /bin/sh), so fork should be used
+*******************************************************************************/
+pid_t spawnNewProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup)
+{
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_t fileActions;
+    sigset_t launchSignals, savedMask, defaultSignals;
+    int inputFD = -1;
+    int outputFD = -1;
+    pid_t spawnPID = -5;
+    int result = -5;
+
+    //Open redirects, with the same messages and exit values as in a forked child
+    if (strlen(ioFiles.inputFile) != 0) {
+        inputFD = open(ioFiles.inputFile, O_RDONLY | O_CLOEXEC);
+        if (inputFD == -1) {
+            printf("cannot open %s for input\n", ioFiles.inputFile);
+            fflush(stdout);
+            exitStatus = EXIT_STATUS(1);
+            return 0;
+        }
+    }
+    if (strlen(ioFiles.outputFile) != 0) {
+        outputFD = open(ioFiles.outputFile, O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+        if (outputFD == -1) {
+            printf("cannot open %s for output\n", ioFiles.outputFile);
+            fflush(stdout);
+            if (inputFD != -1) { close(inputFD); }
+            exitStatus = EXIT_STATUS(2);
+            return 0;
+        }
+    }
+
+    if (posix_spawnattr_init(&attributes) != 0) {
+        if (inputFD != -1) { close(inputFD); }
+        if (outputFD != -1) { close(outputFD); }
+        return -1;
+    }
+    if (posix_spawn_file_actions_init(&fileActions) != 0) {
+        posix_spawnattr_destroy(&attributes);
+        if (inputFD != -1) { close(inputFD); }
+        if (outputFD != -1) { close(outputFD); }
+        return -1;
+    }
+
+    if (stageInput != -1) { posix_spawn_file_actions_adddup2(&fileActions, stageInput, STDIN_FILENO); }
+    if (stageOutput != -1) { posix_spawn_file_actions_adddup2(&fileActions, stageOutput, STDOUT_FILENO); }
+    if (inputFD != -1) { posix_spawn_file_actions_adddup2(&fileActions, inputFD, STDIN_FILENO); }
+    if (outputFD != -1) { posix_spawn_file_actions_adddup2(&fileActions, outputFD, STDOUT_FILENO); }
+
+    //Hold off CTRL-C and CTRL-Z while the shell ignores them
+    sigemptyset(&launchSignals);
+    sigaddset(&launchSignals, SIGINT);
+    sigaddset(&launchSignals, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &launchSignals, &savedMask);
+
+    sigaction(SIGTSTP, &ignore_action, NULL);                   //Child processes ignore SIGTSTP (CTRL-Z)
+    if (inBackground && processGroup == NO_PROCESS_GROUP) { sigaction(SIGINT, &ignore_action, NULL); }
+
+    //Child starts with the shell's usual mask, a foreground child with default SIGINT,
+    //and one in its own group with default SIGINT and SIGTSTP
+    sigemptyset(&defaultSignals);
+    if (!inBackground || processGroup != NO_PROCESS_GROUP) { sigaddset(&defaultSignals, SIGINT); }
+    if (processGroup != NO_PROCESS_GROUP) { sigaddset(&defaultSignals, SIGTSTP); }
+    posix_spawnattr_setsigmask(&attributes, &childSignalMask);
+    posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (processGroup != NO_PROCESS_GROUP) {
+        posix_spawnattr_setpgroup(&attributes, processGroup);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+
+    //Exec a remembered path directly; one that no longer execs is forgotten, and PATH searched again
+    char* commandPath = findCommandPath(commandArgs[0]);
+    if (commandPath) {
+        result = posix_spawn(&spawnPID, commandPath, &fileActions, &attributes, commandArgs, environ);
+        if (result != 0 && result != ENOEXEC) {
+            forgetCommandPath(commandArgs[0]);
+            commandPath = findCommandPath(commandArgs[0]);
+            if (commandPath) { result = posix_spawn(&spawnPID, commandPath, &fileActions, &attributes, commandArgs, environ); }
+        }
+    }
+    if (!commandPath) {
+        result = posix_spawnp(&spawnPID, commandArgs[0], &fileActions, &attributes, commandArgs, environ);
+    }
+
+    sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+    sigaction(SIGINT, &SIGINT_action, NULL);
+    sigprocmask(SIG_SETMASK, &savedMask, NULL);
+
+    posix_spawn_file_actions_destroy(&fileActions);
+    posix_spawnattr_destroy(&attributes);
+    if (inputFD != -1) { close(inputFD); }
+    if (outputFD != -1) { close(outputFD); }
+
+    if (result == ENOSYS || result == ENOEXEC) { return -1; }
+
+    //Exec failures report as a forked child's would
+    if (result != 0) {
+        printf("%s: %s\n", commandArgs[0], strerror(result));
+        fflush(stdout);
+        exitStatus = EXIT_STATUS(1);
+        return 0;
+    }
+
+    return spawnPID;
+}
+
+/******************************************************************************
+ * Launch the process in commandArgs by forking a child process
+ * Sets process group, signal handling and redirects IO in the child, then execs
+ * Returns the child's PID
+*******************************************************************************/
+pid_t forkNewProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup)
+{
+    char* command = commandArgs[0];
+    char* commandPath = findCommandPath(command);
+    pid_t spawnPID = -5;
+
+    //The child cannot tell the shell its exec failed, so a remembered path
+    //that is gone is found out and forgotten here
+    if (commandPath && access(commandPath, X_OK) != 0) {
+        forgetCommandPath(command);
+        commandPath = findCommandPath(command);
+    }
+
+    //Fork and exec specified process
+    spawnPID = fork();
+    switch (spawnPID) {
+        case -1:
+            perror("fork"); exit(1);
+            break;
+
+        case 0:
+
+            if (processGroup != NO_PROCESS_GROUP) { setpgid(0, processGroup); }
+            sigprocmask(SIG_SETMASK, &childSignalMask, NULL);   //Unblock SIGCHLD
+
+            //Child processes ignore SIGTSTP (CTRL-Z), unless in a group of their own;
+            //exec puts the shell's handler back to default
+            if (processGroup == NO_PROCESS_GROUP) { sigaction(SIGTSTP, &ignore_action, NULL); }
+
+            //If background process sharing the shell's group, ignore SIGINT
+            if (inBackground && processGroup == NO_PROCESS_GROUP) {
+                sigaction(SIGINT, &ignore_action, NULL);
+            }
+
+            //Connect pipes, redirect IO and execute, check for errors
+            if (stageInput != -1 && dup2(stageInput, STDIN_FILENO) == -1) { perror("input dup2"); exit(1); }
+            if (stageOutput != -1 && dup2(stageOutput, STDOUT_FILENO) == -1) { perror("output dup2"); exit(2); }
+            redirectIO();
+            if (commandPath) { execv(commandPath, commandArgs); }
+            exitStatus = execvp(command, commandArgs);
+            if (exitStatus == -1) {
+                printf("%s: ", command);
                 fflush(stdout);
+                perror("");
+                exit(1);
+            }
+
+            break;
+
+        default:
+//            printf("Parent process: %d\n", getpid());
+//            fflush(stdout);
+
+            //Also set in the parent, so the group exists before the next stage joins it
+            if (processGroup != NO_PROCESS_GROUP) { setpgid(spawnPID, processGroup); }
+            break;
+    }
+
+    return spawnPID;
+}
+
+/******************************************************************************
+ * Return the FNV-1a hash of passed-in command name
+*******************************************************************************/
+unsigned long hashCommandName(const char *name)
+{
+    unsigned long hash = 14695981039346656037UL;
+
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 1099511628211UL;
+    }
+
+    return hash;
+}
+
+/******************************************************************************
+ * Return the command paths slot holding passed-in name, or the empty slot
+ * where it would go (the table is never full)
+*******************************************************************************/
+struct pathEntry* findPathSlot(const char *name)
+{
+    int mask = commandPaths.capacity - 1;
+    int index = (int)(hashCommandName(name) & (unsigned long)mask);
+
+    while (commandPaths.entries[index].name && strcmp(commandPaths.entries[index].name, name) != 0) {
+        index = (index + 1) & mask;
+    }
+
+    return &commandPaths.entries[index];
+}
+
+/******************************************************************************
+ * Remember passed-in path for passed-in command name
+ * Double table capacity first if it would become over half full
+*******************************************************************************/
+struct pathEntry* addCommandPath(const char *name, const char *path)
+{
+    if ((commandPaths.size + 1) * 2 > commandPaths.capacity) {
+        struct pathEntry* oldEntries = commandPaths.entries;
+        int oldCapacity = commandPaths.capacity;
+
+        commandPaths.capacity *= 2;
+        commandPaths.entries = calloc(commandPaths.capacity, sizeof(struct pathEntry));
+        for (int i = 0; i < oldCapacity; i++) {
+            if (oldEntries[i].name) { *findPathSlot(oldEntries[i].name) = oldEntries[i]; }
+        }
+        free(oldEntries);
+    }
+
+    struct pathEntry* entry = findPathSlot(name);
+    entry->name = strdup(name);
+    entry->path = strdup(path);
+    entry->hits = 0;
+    commandPaths.size++;
+
+    return entry;
+}
+
+/******************************************************************************
+ * Forget the path remembered for passed-in command name, if any
+ * Later entries of its probe run are moved up so none is left unreachable
+*******************************************************************************/
+void forgetCommandPath(const char *name)
+{
+    int mask = commandPaths.capacity - 1;
+    struct pathEntry* entry = findPathSlot(name);
+    if (!entry->name) { return; }
+
+    free(entry->name);
+    free(entry->path);
+    entry->name = NULL;
+    commandPaths.size--;
+
+    int empty = (int)(entry - commandPaths.entries);
+    for (int index = (empty + 1) & mask; commandPaths.entries[index].name; index = (index + 1) & mask) {
+        int home = (int)(hashCommandName(commandPaths.entries[index].name) & (unsigned long)mask);
+
+        //Move up unless its home slot lies after the empty one in this run
+        if (((index - home) & mask) >= ((index - empty) & mask)) {
+            commandPaths.entries[empty] = commandPaths.entries[index];
+            commandPaths.entries[index].name = NULL;
+            empty = index;
+        }
+    }
+}
+
+/******************************************************************************
+ * Forget every remembered command path
+*******************************************************************************/
+void clearPathTable()
+{
+    for (int i = 0; i < commandPaths.capacity; i++) {
+        if (commandPaths.entries[i].name) {
+            free(commandPaths.entries[i].name);
+            free(commandPaths.entries[i].path);
+            commandPaths.entries[i].name = NULL;
+        }
+    }
+    commandPaths.size = 0;
+
+    free(commandPaths.searchPath);
+    commandPaths.searchPath = NULL;
+}
+
+/******************************************************************************
+ * Return the absolute path execvp would run for passed-in command, or
+ * NULL to leave the search to execvp: the command has a /, is not on
+ * PATH, or a relative PATH directory comes before it
+ * Paths are searched for once and remembered until PATH changes
+*******************************************************************************/
+char* findCommandPath(const char *command)
+{
+    struct stat fileInfo;
+    char candidate[MAX_CHARS];
+    const char* searchPath = getenv("PATH");
+
+    if (strchr(command, '/')) { return NULL; }
+    if (!searchPath) { searchPath = DEFAULT_PATH; }
+
+    //Everything remembered was found on the old PATH
+    if (!commandPaths.searchPath || strcmp(commandPaths.searchPath, searchPath) != 0) {
+        clearPathTable();
+        commandPaths.searchPath = strdup(searchPath);
+    }
+
+    struct pathEntry* entry = findPathSlot(command);
+    if (entry->name) {
+        entry->hits++;
+        return entry->path;
+    }
+
+    //Search PATH in order, as execvp does
+    const char* directory = searchPath;
+    while (1) {
+        const char* end = strchr(directory, ':');
+        int length = end ? (int)(end - directory) : (int)strlen(directory);
+
+        if (length == 0 || directory[0] != '/') { return NULL; }     //Empty means the current directory
+
+        if (snprintf(candidate, sizeof(candidate), "%.*s/%s", length, directory, command) < (int)sizeof(candidate) &&
+            stat(candidate, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && access(candidate, X_OK) == 0) {
+            entry = addCommandPath(command, candidate);
+            entry->hits++;
+            return entry->path;
+        }
+
+        if (!end) { return NULL; }
+        directory = end + 1;
+    }
+}
+
+/******************************************************************************
+ * Built-in hash: with no args, list remembered command paths and their hits
+ * -r forgets them all; names are searched for and remembered
+*******************************************************************************/
+void hashCommands(char **commandArgs)
+{
+    if (commandArgs[1] == NULL) {
+        if (commandPaths.size == 0) {
+            printf("hash: hash table empty\n");
+        }
+        else {
+            printf("hits\tcommand\n");
+            for (int i = 0; i < commandPaths.capacity; i++) {
+                if (commandPaths.entries[i].name) {
+                    printf("%4d\t%s\n", commandPaths.entries[i].hits, commandPaths.entries[i].path);
+                }
+            }
+        }
+        fflush(stdout);
+        return;
+    }
+
+    for (int i = 1; commandArgs[i]; i++) {
+        if (strcmp(commandArgs[i], "-r") == 0) {
+            clearPathTable();
+            continue;
+        }
+
+        forgetCommandPath(commandArgs[i]);
+        if (findCommandPath(commandArgs[i])) {
+            findPathSlot(commandArgs[i])->hits = 0;
+        }
+        else {
+            printf("hash: %s: not found\n", commandArgs[i]);
+            fflush(stdout);
+        }
+    }
+}
+
+/******************************************************************************
+ * Save input and/or output file names
+*******************************************************************************/
+void saveIORedirects(char **commandArgs)
+{
+    memset(ioFiles.inputFile, '\0', MAX_CHARS);
+    memset(ioFiles.outputFile, '\0', MAX_CHARS);
+
+    //Start with second command arg
+    int index = 1;
+    char* command = commandArgs[index];
+
+    //Find redirection operators and save following fileName
+    while (command) {
+
+        if (strcmp(command, ">") == 0 || strcmp(command, "<") == 0) {
+
+            if (strcmp(command, ">") == 0) {
+                strcpy(ioFiles.outputFile, commandArgs[index + 1]);
+            }
+
+            else if (strcmp(command, "<") == 0) {
+                strcpy(ioFiles.inputFile, commandArgs[index + 1]);
+            }
+
+            //Move next arguments "left" and reset index
+            if (index + 2 < MAX_ARGS) {                         //Check array bounds
+                commandArgs[index] = commandArgs[index + 2];
+                commandArgs[index + 1] = commandArgs[index + 3];
+
+                commandArgs[index + 2] = NULL;
+                commandArgs[index + 3] = NULL;
+
+                index--;
+            }
+        }
+
+        //Get next command
+        index++;
+        command = commandArgs[index];
+    }
+
+    fflush(stdout);
+}
+
+/******************************************************************************
+ * Redirect input and output to file names saved in redirectFiles struct
+*******************************************************************************/
+void redirectIO() {
+
+    //Resource: https://www.unix.com/programming/268879-c-unix-how-redirect-stdout-file-c-code.html
+    //Resource: http://www.cs.loyola.edu/~jglenn/702/S2005/Examples/dup2.html
+
+    int inputFD = -5;
+    int outputFD = -5;
+    int fileResult = -5;
+
+    //Redirect input
+    if (strlen(ioFiles.inputFile) != 0) {
+        inputFD = open(ioFiles.inputFile, O_RDONLY);
+        if (inputFD == -1) {
+            printf("cannot open %s for input\n", ioFiles.inputFile);
+            fflush(stdout);
+            exit(1);
+        }
+
+        fileResult = dup2(inputFD, STDIN_FILENO);
+        if (fileResult == -1) { perror("input dup2"); exit(1); }
+    }
+
+    //Redirect output
+    if (strlen(ioFiles.outputFile) != 0) {
+        outputFD = open(ioFiles.outputFile, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+        if (outputFD == -1) {
+            printf("cannot open %s for output\n", ioFiles.outputFile);
+            fflush(stdout);
+            exit(2);
+        }
+
+        fileResult = dup2(outputFD, STDOUT_FILENO);
+        if (fileResult == -1) { perror("output dup2"); exit(2); }
+    }
+}
+
+/******************************************************************************
+ * Return the command args joined by spaces, as a job's command line
+*******************************************************************************/
+char* joinCommandArgs(char **commandArgs)
+{
+    size_t length = 1;
+    for (int i = 0; commandArgs[i]; i++) { length += strlen(commandArgs[i]) + 1; }
+
+    char* commandLine = calloc(length, sizeof(char));
+    for (int i = 0; commandArgs[i]; i++) {
+        if (i > 0) { strcat(commandLine, " "); }
+        strcat(commandLine, commandArgs[i]);
+    }
+
+    return commandLine;
+}
+
+/******************************************************************************
+ * Create a job for the passed-in command line of numStages processes,
+ * numbered one past the highest job ID in use
+ * The job takes ownership of commandLine
+*******************************************************************************/
+struct job* createJob(char *commandLine, int numStages, bool inBackground)
+{
+    struct job* job = calloc(1, sizeof(struct job));
+
+    //Resource: https://stackoverflow.com/questions/3536153/c-dynamically-growing-array
+    if (jobs.highestID + 1 >= jobs.idCapacity) {
+        jobs.byID = realloc(jobs.byID, jobs.idCapacity * 2 * sizeof(struct job*));
+        memset(jobs.byID + jobs.idCapacity, 0, jobs.idCapacity * sizeof(struct job*));
+        jobs.idCapacity *= 2;
+    }
+
+    job->id = ++jobs.highestID;
+    jobs.byID[job->id] = job;
+
+    job->group = NO_PROCESS_GROUP;
+    job->pids = calloc(numStages, sizeof(pid_t));
+    job->numPIDs = numStages;
+    job->numLive = 0;
+    job->reportPID = 0;
+    job->status = -5;
+    job->state = JOB_RUNNING;
+    job->background = inBackground;
+    job->waited = false;
+    job->commandLine = commandLine;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+    if (inBackground) { jobs.numBackgroundRunning++; }
+
+    return job;
+}
+
+/******************************************************************************
+ * Return the PID table slot holding passed-in PID, or the empty slot where
+ * it would go (the table is never full)
+*******************************************************************************/
+struct jobSlot* findJobSlot(pid_t pid)
+{
+    int mask = jobs.pidCapacity - 1;
+    int index = (int)(((unsigned)pid * 2654435761u) & (unsigned)mask);
+
+    while (jobs.byPID[index].pid != 0 && jobs.byPID[index].pid != pid) {
+        index = (index + 1) & mask;
+    }
+
+    return &jobs.byPID[index];
+}
+
+/******************************************************************************
+ * Record passed-in PID as the process of a job's stage
+ * Double PID table capacity first if it would become over half full
+*******************************************************************************/
+void addJobProcess(struct job *job, pid_t pid, int stage)
+{
+    if ((jobs.numPIDs + 1) * 2 > jobs.pidCapacity) {
+        struct jobSlot* oldSlots = jobs.byPID;
+        int oldCapacity = jobs.pidCapacity;
+
+        jobs.pidCapacity *= 2;
+        jobs.byPID = calloc(jobs.pidCapacity, sizeof(struct jobSlot));
+        for (int i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i].pid != 0) { *findJobSlot(oldSlots[i].pid) = oldSlots[i]; }
+        }
+        free(oldSlots);
+    }
+
+    struct jobSlot* slot = findJobSlot(pid);
+    slot->pid = pid;
+    slot->job = job;
+    slot->stage = stage;
+    jobs.numPIDs++;
+
+    job->pids[stage] = pid;
+    job->numLive++;
+    job->reportPID = pid;
+}
+
+/******************************************************************************
+ * Forget passed-in PID, once its process is reaped
+ * Later slots of its probe run are moved up so none is left unreachable
+*******************************************************************************/
+void forgetJobProcess(pid_t pid)
+{
+    int mask = jobs.pidCapacity - 1;
+    struct jobSlot* slot = findJobSlot(pid);
+    if (slot->pid == 0) { return; }
+
+    slot->pid = 0;
+    jobs.numPIDs--;
+
+    int empty = (int)(slot - jobs.byPID);
+    for (int index = (empty + 1) & mask; jobs.byPID[index].pid != 0; index = (index + 1) & mask) {
+        int home = (int)(((unsigned)jobs.byPID[index].pid * 2654435761u) & (unsigned)mask);
+
+        //Move up unless its home slot lies after the empty one in this run
+        if (((index - home) & mask) >= ((index - empty) & mask)) {
+            jobs.byPID[empty] = jobs.byPID[index];
+            jobs.byPID[index].pid = 0;
+            empty = index;
+        }
+    }
+}
+
+/******************************************************************************
+ * Change a job's state and whether it is in the background, keeping count
+ * of background jobs running
+*******************************************************************************/
+void setJobState(struct job *job, enum jobState state, bool inBackground)
+{
+    if (job->background && job->state == JOB_RUNNING) { jobs.numBackgroundRunning--; }
+
+    job->state = state;
+    job->background = inBackground;
+
+    if (job->background && job->state == JOB_RUNNING) { jobs.numBackgroundRunning++; }
+}
+
+/******************************************************************************
+ * Remove a job from the job table and free it
+ * The highest job ID in use is lowered past any freed IDs
+*******************************************************************************/
+void removeJob(struct job *job)
+{
+    for (int i = 0; i < job->numPIDs; i++) {
+        if (job->pids[i] > 0) { forgetJobProcess(job->pids[i]); }
+    }
+    setJobState(job, JOB_DONE, false);
+
+    jobs.byID[job->id] = NULL;
+    while (jobs.highestID > 0 && jobs.byID[jobs.highestID] == NULL) {
+        jobs.highestID--;
+    }
+
+    free(job->pids);
+    free(job->commandLine);
+    free(job);
+}
+
+/******************************************************************************
+ * Return the job named by passed-in arg: %ID, or a PID of one of its processes
+ * With no arg, return the current job: the background job with highest ID
+ * Print a message and return NULL if there is no such job
+*******************************************************************************/
+struct job* findJob(const char *builtin, const char *jobName)
+{
+    struct job* job = NULL;
+    char* end = NULL;
+
+    if (jobName == NULL) {
+        for (int id = jobs.highestID; id > 0 && !job; id--) {
+            if (jobs.byID[id] && jobs.byID[id]->background) { job = jobs.byID[id]; }
+        }
+        if (!job) {
+            printf("%s: no current job\n", builtin);
+            fflush(stdout);
+        }
+        return job;
+    }
+
+    long number = strtol(jobName + (jobName[0] == '%'), &end, 10);
+    if (*end == '\0' && number > 0) {
+        if (jobName[0] == '%') {
+            if (number <= jobs.highestID) { job = jobs.byID[number]; }
+        }
+        else {
+            struct jobSlot* slot = findJobSlot((pid_t)number);
+            if (slot->pid != 0) { job = slot->job; }
+        }
+    }
+
+    if (!job) {
+        printf("%s: %s: no such job\n", builtin, jobName);
+        fflush(stdout);
+    }
+    return job;
+}
+
+/******************************************************************************
+ * Send passed-in signal to every live process of a job
+*******************************************************************************/
+void signalJob(struct job *job, int signalNum)
+{
+    if (job->group > 0) {
+        kill(-job->group, signalNum);
+        return;
+    }
+
+    for (int i = 0; i < job->numPIDs; i++) {
+        if (job->pids[i] > 0) { kill(job->pids[i], signalNum); }
+    }
+}
+
+/******************************************************************************
+ * Wait for a foreground job to finish or be stopped
+ * Other jobs finishing meanwhile are reaped and saved to report
+ * A job in its own group that the shell could not give the terminal only
+ * hears CTRL-C through the shell, so it is passed on
+*******************************************************************************/
+void waitForJob(struct job *job)
+{
+    interrupted = false;
+
+    //Reap before each wait, as children may be done before SIGCHLD is read
+    reapChildren();
+    while (job->state == JOB_RUNNING) {
+        waitForChildSignal();
+        if (interrupted && job->group > 0 && !terminalControl) {
+            signalJob(job, SIGINT);
+            interrupted = false;
+        }
+    }
+}
+
+/******************************************************************************
+ * Take the terminal back after a foreground job
+ * A finished job sets status, printed if terminated by a signal, and is removed
+ * A stopped job is kept in the background, ready for fg or bg
+*******************************************************************************/
+void finishForegroundJob(struct job *job)
+{
+    giveTerminal(shellGroup);
+
+    if (job->state == JOB_STOPPED) {
+        setJobState(job, JOB_STOPPED, true);
+        printf("[%d] stopped: %s\n", job->id, job->commandLine);
+        fflush(stdout);
+        return;
+    }
+
+    exitStatus = job->status;
+    removeJob(job);
+
+    if (WIFSIGNALED(exitStatus)) {
+        printf("terminated by signal %d\n", WTERMSIG(exitStatus));
+        fflush(stdout);
+    }
+}
+
+/******************************************************************************
+ * Block until SIGCHLD arrives or a signal handler runs, then reap
+*******************************************************************************/
+void waitForChildSignal()
+{
+    struct pollfd waitFD = {childSignalFD, POLLIN, 0};
+
+    if (poll(&waitFD, 1, -1) == -1 && errno != EINTR) { perror("poll"); exit(1); }
+    reapChildren();
+}
+
+/******************************************************************************
+ * Drain SIGCHLD from its signalfd and reap every child that changed
+ * Each is found in the job table by PID; stopping or continuing changes its
+ * job's state, and once every process of a job is done, so is the job
+ * A background job that is done is saved to be reported by
+ * findCompletedProcesses and removed, unless the wait builtin is waiting on it
+*******************************************************************************/
+void reapChildren()
+{
+    struct signalfd_siginfo childInfo;
+    pid_t completed = -5;
+    int exitMethod = -5;
+
+    //Signals merge, so each read only says that some child has changed
+    while (read(childSignalFD, &childInfo, sizeof(childInfo)) == sizeof(childInfo)) {}
+
+    while ((completed = waitpid(-1, &exitMethod, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+
+        struct jobSlot* slot = findJobSlot(completed);
+        if (slot->pid == 0) { continue; }
+        struct job* job = slot->job;
+
+        if (WIFSTOPPED(exitMethod)) {
+            if (job->state == JOB_RUNNING) { setJobState(job, JOB_STOPPED, job->background); }
+            continue;
+        }
+        if (WIFCONTINUED(exitMethod)) {
+            if (job->state == JOB_STOPPED) { setJobState(job, JOB_RUNNING, job->background); }
+            continue;
+        }
+
+        //Process is done; its PID may now be reused
+        if (slot->stage == job->numPIDs - 1) { job->status = exitMethod; }
+        job->pids[slot->stage] = 0;
+        forgetJobProcess(completed);
+
+        if (--job->numLive > 0) { continue; }
+
+        if (job->background) { jobs.numFinished++; }
+        jobs.lastFinishedStatus = job->status;
+        if (job->background && !job->waited) {
+            saveCompletedJob(job);
+            removeJob(job);
+        }
+        else {
+            setJobState(job, JOB_DONE, job->background);
+        }
+    }
+}
+
+/******************************************************************************
+ * Save a finished background job to be reported by findCompletedProcesses
+*******************************************************************************/
+void saveCompletedJob(struct job *job)
+{
+    if (completedPIDs.size >= completedPIDs.capacity) {
+        completedPIDs.capacity *= 2;
+        completedPIDs.entries = realloc(completedPIDs.entries,
+                                        completedPIDs.capacity * sizeof(struct completion));
+    }
+    completedPIDs.entries[completedPIDs.size].pid = job->reportPID;
+    completedPIDs.entries[completedPIDs.size].status = job->status;
+    completedPIDs.size++;
+}
+
+/******************************************************************************
+ * Reap finished children, then report completed background processes
+ * For all completed, print message with PID and exit/termination method
+ * Return the number reported
+*******************************************************************************/
+int findCompletedProcesses()
+{
+    reapChildren();
+
+    int numReported = completedPIDs.size;
+    for (int i = 0; i < completedPIDs.size; i++) {
+        int completed = completedPIDs.entries[i].pid;
+        int exitMethod = completedPIDs.entries[i].status;
+
+        printf("background pid %d is done: ", completed);
+        fflush(stdout);
+
+        // If process terminated normally
+        if (WIFEXITED(exitMethod)) {
+            printf("exit value %d\n", WEXITSTATUS(exitMethod));
+            fflush(stdout);
+        }
+
+        // Else process terminated by a signal
+        else if (WIFSIGNALED(exitMethod)) {
+            printf("terminated by signal %d\n", WTERMSIG(exitMethod));
+            fflush(stdout);
+        }
+    }
+    completedPIDs.size = 0;
+
+    return numReported;
+}
+
+/******************************************************************************
+ * Built-in jobs: list background jobs with ID, PID, state, time since
+ * started, and command line
+*******************************************************************************/
+void listJobs(char **commandArgs)
+{
+    const char* stateNames[] = {"Running", "Stopped", "Done"};
+    struct timespec now;
+
+    reapChildren();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int id = 1; id <= jobs.highestID; id++) {
+        struct job* job = jobs.byID[id];
+        if (!job || !job->background) { continue; }
+
+        double elapsed = (double)(now.tv_sec - job->started.tv_sec) +
+                         (double)(now.tv_nsec - job->started.tv_nsec) / 1e9;
+        printf("[%d] %d %-7s %8.1fs  %s\n", job->id, (int)job->reportPID, stateNames[job->state],
+               elapsed, job->commandLine);
+    }
+    fflush(stdout);
+}
+
+/******************************************************************************
+ * Built-in fg: continue a background job (the current one if none named)
+ * in the foreground, holding the terminal, and wait for it
+*******************************************************************************/
+void foregroundJob(char **commandArgs)
+{
+    struct job* job = findJob("fg", commandArgs[1]);
+    if (!job) { return; }
+
+    printf("%s\n", job->commandLine);
+    fflush(stdout);
+
+    setJobState(job, JOB_RUNNING, false);
+    if (job->group > 0) { giveTerminal(job->group); }
+    signalJob(job, SIGCONT);
+
+    waitForJob(job);
+    finishForegroundJob(job);
+}
+
+/******************************************************************************
+ * Built-in bg: continue a stopped job (the latest stopped one if none
+ * named) in the background
+*******************************************************************************/
+void backgroundJob(char **commandArgs)
+{
+    struct job* job = NULL;
+
+    //Current job for bg is the stopped one with highest ID
+    for (int id = jobs.highestID; id > 0 && !job && !commandArgs[1]; id--) {
+        if (jobs.byID[id] && jobs.byID[id]->state == JOB_STOPPED) { job = jobs.byID[id]; }
+    }
+    if (!job) { job = findJob("bg", commandArgs[1]); }
+    if (!job) { return; }
+
+    if (job->state != JOB_STOPPED) {
+        printf("bg: job %d already in background\n", job->id);
+        fflush(stdout);
+        return;
+    }
+
+    setJobState(job, JOB_RUNNING, true);
+    signalJob(job, SIGCONT);
+
+    printf("[%d] %s &\n", job->id, job->commandLine);
+    fflush(stdout);
+}
+
+/******************************************************************************
+ * Built-in wait: with no args, wait for every running background job
+ * -n waits for the next background job to finish; a %ID or PID waits for
+ * that job; status becomes that job's
+ * CTRL-C stops the wait
+*******************************************************************************/
+void waitForJobs(char **commandArgs)
+{
+    interrupted = false;
+    reapChildren();
+
+    if (commandArgs[1] == NULL) {
+        while (jobs.numBackgroundRunning > 0 && !interrupted) {
+            waitForChildSignal();
+        }
+        exitStatus = EXIT_STATUS(0);
+    }
+
+    else if (strcmp(commandArgs[1], "-n") == 0) {
+        int numFinished = jobs.numFinished;
+        while (jobs.numFinished == numFinished && jobs.numBackgroundRunning > 0 && !interrupted) {
+            waitForChildSignal();
+        }
+        exitStatus = (jobs.numFinished != numFinished) ? jobs.lastFinishedStatus : EXIT_STATUS(127);
+    }
+
+    else {
+        for (int i = 1; commandArgs[i]; i++) {
+            struct job* job = findJob("wait", commandArgs[i]);
+            if (!job) {
+                exitStatus = EXIT_STATUS(127);
+                continue;
             }
 
-            // Else process terminated by a signal
-            else if (WIFSIGNALED(exitMethod)) {
-                printf("terminated by signal %d\n", WTERMSIG(exitMethod));
-                fflush(stdout);
+            //Keep the job once done, to take its status
+            job->waited = true;
+            while (job->state == JOB_RUNNING && !interrupted) {
+                waitForChildSignal();
             }
+            job->waited = false;
 
-            deleteFromProcessList(completed, &backgroundPIDs);
+            if (job->state == JOB_DONE) {
+                exitStatus = job->status;
+                if (job->background) { saveCompletedJob(job); }
+                removeJob(job);
+            }
+            else {
+                exitStatus = EXIT_STATUS(128 + (interrupted ? SIGINT : SIGSTOP));
+            }
         }
-
-    } while (completed > 0);
+    }
 }
 
 /******************************************************************************
  * Clean up processes, return to working directory, exit the shell
+ * Only an explicit exit takes background jobs down with it
 *******************************************************************************/
 void exitShell()
 {
-    //Terminate background processes
-    for (int i = 0; i < backgroundPIDs.size; i++) {
-        kill(backgroundPIDs.pids[i], SIGKILL);
+    //Terminate background jobs
+    for (int id = 1; id <= jobs.highestID; id++) {
+        if (jobs.byID[id]) { signalJob(jobs.byID[id], SIGKILL); }
     }
 
+    leaveShell();
+}
+
+/******************************************************************************
+ * Return to working directory and exit the shell, leaving background jobs
+ * running
+*******************************************************************************/
+void leaveShell()
+{
     //Return to working directory
     changeDirectory(startingDirectory);
 
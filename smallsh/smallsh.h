@@ -12,11 +12,16 @@
 #include <zconf.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
+#include <poll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
 
 #define bool sig_atomic_t
 #define true 1
@@ -26,21 +31,107 @@
 #define MAX_ARGS 512
 
 #define CMD_PROMPT ": "
+#define SHELL_USAGE "USAGE: smallsh [-e] [-c commands | script]"
 #define EXPAND_PID "$$"
+#define PIPE_OPERATOR "|"
+#define NO_PROCESS_GROUP -1              //Child stays in the shell's process group
 #define START_CAPACITY 3
+#define INPUT_START_CAPACITY 4096
+#define PATH_TABLE_START_CAPACITY 64   //Power of two
+#define JOB_TABLE_START_CAPACITY 64    //Power of two
+#define BUILTIN_TABLE_SIZE 32          //Power of two; hashBuiltinName is perfect for the builtins
+#define DEFAULT_PATH "/bin:/usr/bin"    //Searched by execvp when PATH is unset
+#define EXIT_STATUS(value) ((value) << 8)     //Wait status of a normal exit with value
 
 bool continueExecution = true;
 bool backgroundProcess = false;
 bool foregroundOnly = false;
+bool interrupted = false;               //Set by SIGINT (CTRL-C)
+bool runningScript = false;             //Commands come from a script or -c, not a prompt
+bool stopOnError = false;               //-e: exit once a command fails
 int exitStatus = 0;                 //If status run before other commands
 char* startingDirectory = NULL;
+pid_t shellGroup = 0;
+bool terminalControl = false;       //Whether stdin is a terminal the shell may hand over
+extern char** environ;
 
-struct pidList {
-    int* pids;
+enum jobState { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+struct job {
+    int id;
+    pid_t group;                        //Process group, or NO_PROCESS_GROUP if the shell's
+    pid_t* pids;                        //One per stage; 0 once done or if never started
+    int numPIDs;
+    int numLive;                        //Processes started and not yet done
+    pid_t reportPID;                    //Last stage started, reported as the job's PID
+    int status;                         //Last stage's wait status
+    enum jobState state;
+    bool background;
+    bool waited;                        //The wait builtin takes it when done
+    struct timespec started;            //CLOCK_MONOTONIC
+    char* commandLine;
+};
+struct jobSlot {
+    pid_t pid;                          //0 if the slot is empty
+    struct job* job;
+    int stage;
+};
+struct jobTable {
+    struct job** byID;                  //NULL where an ID is free
+    int idCapacity;
+    int highestID;
+    struct jobSlot* byPID;
+    int pidCapacity;
+    int numPIDs;
+    int numBackgroundRunning;
+    int numFinished;                    //Background jobs done, for wait -n
+    int lastFinishedStatus;
+};
+struct jobTable jobs;
+
+struct completion {
+    int pid;
+    int status;
+};
+struct completionList {
+    struct completion* entries;
+    int size;
+    int capacity;
+};
+struct completionList completedPIDs;    //Background processes done, not yet reported
+
+int childSignalFD = -1;                 //signalfd for SIGCHLD
+sigset_t childSignalMask;               //Signal mask children start with
+
+struct inputBuffer {
+    int fd;                             //Where more input is read from
+    char* data;                         //Mapped if a whole script file
+    size_t start;                       //First char not yet taken
+    size_t end;                         //One past the last char read
+    size_t capacity;
+    bool atEnd;                         //Input has run out
+    bool mapped;                        //data is mmapped, not malloced
+};
+struct inputBuffer shellInput;
+
+struct pathEntry {
+    char* name;                     //NULL if the slot is empty
+    char* path;
+    int hits;
+};
+struct pathTable {
+    struct pathEntry* entries;
     int size;
     int capacity;
+    char* searchPath;               //PATH the entries were found on
+};
+struct pathTable commandPaths;
+
+struct builtin {
+    const char* name;               //NULL if the slot is empty
+    void (*run)(char **commandArgs);
 };
-struct pidList backgroundPIDs;
+struct builtin builtins[BUILTIN_TABLE_SIZE];
 
 struct redirectFiles {
     char inputFile[MAX_CHARS];
@@ -52,23 +143,77 @@ struct sigaction SIGINT_action = {{0}};
 struct sigaction SIGTSTP_action = {{0}};
 struct sigaction ignore_action = {{0}};
 
+void initShellInput(int argc, char *argv[]);
+void loadScript(const char *path);
+int shellExitValue();
 void initSignalHandlers();
+void initChildSignals();
 void catchSIGINT(int signalNum);
 void catchSIGTSTP(int signalNum);
 char* getWorkingDirectory(char *directoryName);
 void runShell();
 char* promptCommandLine();
+char* takeInputLine();
+ssize_t readInput();
 char *expandPID(char *inputString);
 void clearCommandArgs(char **commandArgs, int numArgs);
 void saveCommandArgs(char *userInput, char** commandArgs);
 void processCommandArgs(char** commandArgs);
+void initBuiltins();
+unsigned int hashBuiltinName(const char *name);
+struct builtin* findBuiltin(const char *command);
+void runBuiltin(struct builtin *builtin, char **commandArgs);
+void changeDirectoryBuiltin(char **commandArgs);
+void printStatus(char **commandArgs);
+void exitShellBuiltin(char **commandArgs);
+void echoArgs(char **commandArgs);
+bool printEscape(const char **text);
+void printFormatted(char **commandArgs);
+void printWorkingDirectory(char **commandArgs);
+void testExpression(char **commandArgs);
+int evaluateTest(char **args, int numArgs);
+int compareTest(const char *left, const char *op, const char *right);
+void returnTrue(char **commandArgs);
+void returnFalse(char **commandArgs);
+bool isVariableName(const char *name, size_t length);
+void exportVariables(char **commandArgs);
+void unsetVariables(char **commandArgs);
 void saveIORedirects(char **commandArgs);
 void redirectIO();
-void addToProcessList(int pid, struct pidList *processList);
-void deleteFromProcessList(int pid, struct pidList *processList);
-void findCompletedProcesses();
+char* joinCommandArgs(char **commandArgs);
+struct job* createJob(char *commandLine, int numStages, bool inBackground);
+struct jobSlot* findJobSlot(pid_t pid);
+void addJobProcess(struct job *job, pid_t pid, int stage);
+void forgetJobProcess(pid_t pid);
+void setJobState(struct job *job, enum jobState state, bool inBackground);
+void removeJob(struct job *job);
+struct job* findJob(const char *builtin, const char *jobName);
+void signalJob(struct job *job, int signalNum);
+void waitForJob(struct job *job);
+void finishForegroundJob(struct job *job);
+void waitForChildSignal();
+void reapChildren();
+void saveCompletedJob(struct job *job);
+int findCompletedProcesses();
+void listJobs(char **commandArgs);
+void foregroundJob(char **commandArgs);
+void backgroundJob(char **commandArgs);
+void waitForJobs(char **commandArgs);
 void changeDirectory(char *path);
+unsigned long hashCommandName(const char *name);
+struct pathEntry* findPathSlot(const char *name);
+struct pathEntry* addCommandPath(const char *name, const char *path);
+void forgetCommandPath(const char *name);
+void clearPathTable();
+char* findCommandPath(const char *command);
+void hashCommands(char **commandArgs);
 void executeNewProcess(char **commandArgs);
+bool isPipeline(char **commandArgs);
+void giveTerminal(pid_t processGroup);
+pid_t launchProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup);
+pid_t spawnNewProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup);
+pid_t forkNewProcess(char **commandArgs, bool inBackground, int stageInput, int stageOutput, pid_t processGroup);
 void exitShell();
+void leaveShell();
 
 #endif //SMALLSH_SMALLSH_H